@@ -1,10 +1,17 @@
 #include<iostream>
 #include "chess.hpp"
+#include "evaluate.hpp"
+#include "endgame.hpp"
+#include "tablebase.hpp"
+#include "perft.hpp"
 #include<vector>
 #include<sstream>
 #include<limits>
 #include<unordered_map>
 #include<chrono>
+#include<memory>
+#include<thread>
+#include<algorithm>
 using namespace std;
 using namespace chess;
 
@@ -13,6 +20,111 @@ chrono::steady_clock::time_point searchStartTime;
 chrono::milliseconds timeLimit;
 bool timeUp = false;
 
+const int LAZY_EVAL_MARGIN = 500;
+const int TB_WIN_SCORE = 15000;
+uint64_t evalCount = 0;
+uint64_t lazyEvalExits = 0;
+uint64_t nodeCount = 0;
+
+// Copy-make (the CopyMake option): the search keeps the position of every ply
+// in positionStack and makes a move with Board::doMove into the next slot, so
+// taking it back is just stepping down a slot. Move generation and the eval
+// read a Board, which syncBoard() loads from the stack only when a node reads
+// it; a parent going on to its next move in legal mode never does. The search
+// is single-threaded, so one stack will do. stackPly counts plies in both
+// modes, and the search stops at MAX_SEARCH_PLY.
+const int MAX_SEARCH_PLY = 256;
+bool copyMake = false;
+Position positionStack[MAX_SEARCH_PLY];
+int stackPly = 0;
+int loadedPly = 0;
+
+// Keys of the game and of the search path, for repetition draws in alphaBeta.
+// The root's key is pushed at index rootHistorySize, so the distance from the
+// root is repetitions.size() - rootHistorySize.
+RepetitionHistory repetitions;
+int rootHistorySize = 0;
+
+// Pseudo-legal generation (the PseudoLegal option): nodes generate with
+// movegen::pseudolegalmoves and test a move with movegen::isLegal only when
+// they get to it, so a node that cuts off early never pays for the legality
+// of the moves after the cutoff. The pins and checkers isLegal needs are
+// computed once per node. Legal moves come in the same order either way, so
+// both modes search the same tree.
+bool pseudoLegal = false;
+
+template <movegen::MoveGenType mt = movegen::MoveGenType::ALL>
+void generateMoves(Movelist &ml, const Board &board)
+{
+    if (pseudoLegal) movegen::pseudolegalmoves<mt>(ml, board);
+    else movegen::legalmoves<mt>(ml, board);
+}
+
+// Captures and quiet moves as two lists. In check that is one pass of the
+// evasion generator split in two, with the moves in the same order.
+void generateCapturesAndQuiets(const Board &board, Movelist &captures, Movelist &quiets)
+{
+    if (!board.inCheck()) {
+        generateMoves<movegen::MoveGenType::CAPTURE>(captures, board);
+        generateMoves<movegen::MoveGenType::QUIET>(quiets, board);
+        return;
+    }
+    Movelist evasions;
+    generateMoves<movegen::MoveGenType::EVASIONS>(evasions, board);
+    captures.clear();
+    quiets.clear();
+    for (const auto &m : evasions) {
+        if (board.isCapture(m)) captures.add(m);
+        else quiets.add(m);
+    }
+}
+
+// Stops at the first legal move in pseudo-legal mode.
+bool hasLegalMove(const Board &board)
+{
+    Movelist ml;
+    if (board.inCheck()) generateMoves<movegen::MoveGenType::EVASIONS>(ml, board);
+    else generateMoves(ml, board);
+    if (!pseudoLegal) return !ml.empty();
+    const auto info = movegen::legalityInfo(board);
+    for (const auto &m : ml) {
+        if (movegen::isLegal(board, info, m)) return true;
+    }
+    return false;
+}
+
+// Loads the current stack slot into the board if it holds another one.
+void syncBoard(SearchBoard &board)
+{
+    if (copyMake && loadedPly != stackPly) {
+        board.setPosition(positionStack[stackPly]);
+        loadedPly = stackPly;
+    }
+}
+
+// The caller keeps stackPly below MAX_SEARCH_PLY - 1.
+void playMove(SearchBoard &board, const Move &m)
+{
+    if (!copyMake) {
+        repetitions.push(board.hash());
+        board.makeMove(m);
+        stackPly++;
+        return;
+    }
+    repetitions.push(positionStack[stackPly].key);
+    Board::doMove(positionStack[stackPly], m, positionStack[stackPly + 1]);
+    stackPly++;
+    // The board may still hold the previous move's position from this slot.
+    if (loadedPly == stackPly) loadedPly = -1;
+}
+
+void takeBack(SearchBoard &board, const Move &m)
+{
+    repetitions.pop();
+    stackPly--;
+    if (!copyMake) board.unmakeMove(m);
+}
+
 struct TranspositionEntry {
     uint64_t positionHash;    
     int searchDepth;         
@@ -49,29 +161,16 @@ bool isTimeUp() {
     return elapsed >= timeLimit;
 }
 
+// The check test comes first, so each of these only generates moves in the
+// positions where it can be true.
 bool isCheckmate(Board &board) 
 {
-    Movelist ml;
-    movegen::legalmoves<>(ml, board);
-    return ml.empty() && board.inCheck();
+    return board.inCheck() && !hasLegalMove(board);
 }
 
 bool isStalemate(Board &board)
 {
-    Movelist ml;
-    movegen::legalmoves<>(ml,board);
-    return ml.empty() && !board.inCheck();
-}
-
-int getpieceValue(PieceType piece)
-{
-    if (piece == PieceType::PAWN) return 100;
-    if (piece == PieceType::KNIGHT) return 320;
-    if (piece == PieceType::BISHOP) return 330;
-    if (piece == PieceType::ROOK) return 500;
-    if (piece == PieceType::QUEEN) return 900;
-    if (piece == PieceType::KING) return 20000;
-    return 0;
+    return !board.inCheck() && !hasLegalMove(board);
 }
 
 PieceType getcapturedPiece(const Board &board, const Move &move)
@@ -79,214 +178,73 @@ PieceType getcapturedPiece(const Board &board, const Move &move)
     return board.at<PieceType>(move.to());
 }
 
-bool isEndgame(Board &board) {
-    int material = 0;
-    for (PieceType pt : {PieceType::QUEEN, PieceType::ROOK, PieceType::BISHOP, PieceType::KNIGHT}) {
-        material += getpieceValue(pt) * (board.pieces(pt, Color::WHITE).count() + board.pieces(pt, Color::BLACK).count());
-    }
-    return material < 2500;
-}
-
-int evaluateKingActivity(Board &board, bool endgame) {
-    int score = 0;
-    
-    for (Color c : {Color::WHITE, Color::BLACK}) {
-        Bitboard king = board.pieces(PieceType::KING, c);
-        if (king) {
-            Square kingSq = king.pop();
-            int kingRank = kingSq.rank();
-            int kingFile = kingSq.file();
-            
-            if (endgame) 
-            {
-                int centerDistance = abs(kingFile - 3.5) + abs(kingRank - 3.5);
-                score += (c == Color::WHITE ? 1 : -1) * (7 - centerDistance) * 10;
-            } 
-            else 
-            {
-                int shield = 0;
-                int shieldRank = kingRank + (c == Color::WHITE ? 1 : -1);
-                
-                if (shieldRank >= 0 && shieldRank <= 7) {
-                    for (int a = -1; a <= 1; ++a) {
-                        int shieldFile = kingFile + a;
-                        if (shieldFile >= 0 && shieldFile <= 7) {
-                            Square shieldSq = Square(static_cast<File>(shieldFile), static_cast<Rank>(shieldRank));
-                            Piece p = board.at(shieldSq);
-                            if (p.type() == PieceType::PAWN && p.color() == c) {
-                                shield++;
-                            }
-                        }
-                    }
-                }
-                score += (c == Color::WHITE ? 1 : -1) * shield * 10;
-            }
-        }
-    }
-    return score;
-}
-
-int evaluateRooks(Board &board) {
-    int score = 0;
-    
-    for (Color c : {Color::WHITE, Color::BLACK}) {
-        Bitboard rooks = board.pieces(PieceType::ROOK, c);
-        while (rooks) {
-            Square rookSq = rooks.pop();
-            int file = rookSq.file();
-            int rank = rookSq.rank();
-            bool openFile = true;
-            for (int r = 0; r < 8; r++) {
-                Square sq = Square(static_cast<File>(file), static_cast<Rank>(r));
-                if (board.at<PieceType>(sq) == PieceType::PAWN) {
-                    openFile = false;
-                    break;
-                }
-            }
-            if (openFile) {
-                score += (c == Color::WHITE ? 1 : -1) * 25;
-            }
-            if ((c == Color::WHITE && rank == 6) || (c == Color::BLACK && rank == 1)) {
-                score += (c == Color::WHITE ? 1 : -1) * 20;
-            }
-        }
-    }
-    return score;
-}
-
-int evaluateBoard(Board &board) 
+// Passing a window lets the eval return the material score straight away when it
+// is more than LAZY_EVAL_MARGIN outside [alpha, beta]. The margin is a heuristic,
+// not a bound: passed pawns, mobility, king-zone and threat terms can add up to
+// more, so a lazy exit can now and then return a score on the wrong side.
+// We only do that when not in check and the side to move still has pieces, so
+// checkmates and the usual bare-king stalemates still go through the full eval.
+int evaluateBoard(Board &board, int alpha = -INF, int beta = INF) 
 {
-    if (isCheckmate(board)) 
-    {
-        return -20000;
-    }
-    else if (isStalemate(board))
+    evalCount++;
+    
+    if (board.isInsufficientMaterial())
     {
         return 0;
     }
     
-    int score = 0;
-    bool endgame = isEndgame(board);
-    
-    for (PieceType pt : {PieceType::PAWN, PieceType::KNIGHT, PieceType::BISHOP, PieceType::ROOK, PieceType::QUEEN, PieceType::KING}) 
+    int egScore;
+    if (probeEndgame(board, egScore))
     {
-        Bitboard wBB = board.pieces(pt, Color::WHITE);
-        Bitboard bBB = board.pieces(pt, Color::BLACK);
-        int wCount = wBB.count();
-        int bCount = bBB.count();   
-        score += getpieceValue(pt) * (wCount - bCount);
-    }
-
-    if (!endgame) {
-        array<Square,4> center = { Square("d4"),Square("d5"),Square("e4"),Square("e5") };
-        array<Square,8> centerControl = { Square("c3"),Square("d3"),Square("e3"),Square("f3"),
-                                         Square("c6"),Square("d6"),Square("e6"),Square("f6") };
-        
-        for (auto sq: center) {
-            Piece p = board.at(sq);
-            if (p != Piece::NONE) {
-                if (p.color() == Color::WHITE) score += 30;
-                else if (p.color() == Color::BLACK) score -= 30;
-            }
-        }
-        
-        for (auto sq: centerControl) {
-            Piece p = board.at(sq);
-            if (p.type() == PieceType::PAWN) {
-                if (p.color() == Color::WHITE) score += 15;
-                else if (p.color() == Color::BLACK) score -= 15;
-            }
-        }
+        if (isCheckmate(board)) return -20000;
+        if (isStalemate(board)) return 0;
+        return board.sideToMove() == Color::WHITE ? egScore : -egScore;
     }
     
-    Bitboard wp = board.pieces(PieceType::PAWN, Color::WHITE);
-    while (wp) 
+    if (!board.inCheck() && board.hasNonPawnMaterial(board.sideToMove()))
     {
-        Square sq = wp.pop();
-        int rank = sq.rank();
-        int file = sq.file();
-        score += 3 * rank;
-        if (file == 3 || file == 4) {
-            score += 5 * rank;
-            if (rank == 3) score += 10;
-            if (rank == 4) score += 15;
-        }
-        
-        bool passed = true;
-        for (int r = rank + 1; r < 8; r++) {
-            for (int f = max(0, file-1); f <= min(7, file+1); f++) {
-                Square checkSq = Square(static_cast<File>(f), static_cast<Rank>(r));
-                if (board.at<PieceType>(checkSq) == PieceType::PAWN && 
-                    board.at(checkSq).color() == Color::BLACK) {
-                    passed = false;
-                    break;
-                }
-            }
-            if (!passed) break;
-        }
-        if (passed && rank > 3) {
-            score += (endgame ? 50 : 25) * (rank - 3);
+        int lazy = evaluateMaterial(board);
+        if (board.sideToMove() == Color::BLACK) lazy = -lazy;
+        if (lazy - LAZY_EVAL_MARGIN >= beta || lazy + LAZY_EVAL_MARGIN <= alpha)
+        {
+            lazyEvalExits++;
+            return lazy;
         }
     }
     
-    Bitboard bp = board.pieces(PieceType::PAWN, Color::BLACK);
-    while (bp) 
+    if (isCheckmate(board)) 
     {
-        Square sq = bp.pop();
-        int rank = sq.rank();
-        int file = sq.file();
-        score -= 3 * (7 - rank);
-        if (file == 3 || file == 4) {
-            score -= 5 * (7 - rank);
-            if (rank == 4) score -= 10;
-            if (rank == 3) score -= 15;
-        }
-        
-        bool passed = true;
-        for (int r = rank - 1; r >= 0; r--) {
-            for (int f = max(0, file-1); f <= min(7, file+1); f++) {
-                Square checkSq = Square(static_cast<File>(f), static_cast<Rank>(r));
-                if (board.at<PieceType>(checkSq) == PieceType::PAWN && 
-                    board.at(checkSq).color() == Color::WHITE) {
-                    passed = false;
-                    break;
-                }
-            }
-            if (!passed) break;
-        }
-        if (passed && rank < 4) {
-            score -= (endgame ? 50 : 25) * (4 - rank);
-        }
+        return -20000;
+    }
+    else if (isStalemate(board))
+    {
+        return 0;
     }
     
-    score += evaluateKingActivity(board, endgame);
-    score += evaluateRooks(board);
-    
-    Bitboard bB = board.pieces(PieceType::BISHOP, Color::BLACK);
-    Bitboard wB = board.pieces(PieceType::BISHOP, Color::WHITE);
-    int bCount = bB.count();
-    int wCount = wB.count();
-    if (wCount >= 2) score += 50;
-    if (bCount >= 2) score -= 50;
-
+    int score = evaluateStatic(board);
+    score = score * endgameScale(board, score) / SCALE_NORMAL;
     return board.sideToMove() == Color::WHITE ? score : -score;
 }
 
-int quiesce(Board &board, int alpha, int beta) 
+int quiesce(SearchBoard &board, int alpha, int beta) 
 {
+    nodeCount++;
+    syncBoard(board);
     if (isTimeUp()) {
         timeUp = true;
         return evaluateBoard(board);
     }
+    if (stackPly + 1 >= MAX_SEARCH_PLY) {
+        return evaluateBoard(board);
+    }
     
-    int stand = evaluateBoard(board);
+    int stand = evaluateBoard(board, alpha, beta);
     if (stand >= beta) return beta;
     if (stand > alpha) alpha = stand;
     
     Movelist captures;
-    movegen::legalmoves<movegen::MoveGenType::CAPTURE>(captures, board);
     Movelist quiets;
-    movegen::legalmoves<movegen::MoveGenType::QUIET>(quiets, board);
+    generateCapturesAndQuiets(board, captures, quiets);
     for (auto &m : quiets) {
         PieceType piece = board.at<PieceType>(m.from());
         if (piece == PieceType::PAWN) {
@@ -328,15 +286,22 @@ int quiesce(Board &board, int alpha, int beta)
             }
         }
         
+        // Rotate rather than swap, so that equal captures keep their order
+        // and pseudo-legal mode searches them in the same order.
         if (best != i) {
-            swap(captures[i], captures[best]);
+            rotate(captures.begin() + i, captures.begin() + best, captures.begin() + best + 1);
         }
     }
     
+    const auto legality = pseudoLegal ? movegen::legalityInfo(board) : movegen::LegalityInfo{};
     for (auto &m : captures) {
-        board.makeMove(m);
+        if (pseudoLegal) {
+            syncBoard(board);
+            if (!movegen::isLegal(board, legality, m)) continue;
+        }
+        playMove(board, m);
         int score = -quiesce(board, -beta, -alpha);
-        board.unmakeMove(m);
+        takeBack(board, m);
         
         if (score >= beta) return beta;
         if (score > alpha) alpha = score;
@@ -345,25 +310,18 @@ int quiesce(Board &board, int alpha, int beta)
     return alpha;
 }
 
+// Appends the moves other than bestfromprev, which the caller has already
+// searched, to `ordered`.
 void orderMoves(const Board &board, Movelist &ordered, const Move &bestfromprev = Move::NULL_MOVE) 
 {
-    ordered.clear();
-    
     Movelist captures;
-    movegen::legalmoves<movegen::MoveGenType::CAPTURE>(captures, board);
-    
     Movelist quiets;
-    movegen::legalmoves<movegen::MoveGenType::QUIET>(quiets, board);
+    generateCapturesAndQuiets(board, captures, quiets);
     
     Movelist promotions;
     Movelist castles;
     Movelist checks; 
     Movelist others;
-
-    if (bestfromprev != Move::NULL_MOVE)
-    {
-        ordered.add(bestfromprev);
-    }
     
     for (auto &m : quiets) {
         PieceType piece = board.at<PieceType>(m.from());
@@ -379,7 +337,7 @@ void orderMoves(const Board &board, Movelist &ordered, const Move &bestfromprev
             continue;
         }
         
-        Board tempBoard = board;
+        SearchBoard tempBoard(board);
         tempBoard.makeMove(m);
         if (tempBoard.inCheck()) {
             checks.add(m); 
@@ -415,8 +373,10 @@ void orderMoves(const Board &board, Movelist &ordered, const Move &bestfromprev
             }
         }
         
+        // Rotate rather than swap, so that equal captures keep their order
+        // and pseudo-legal mode searches them in the same order.
         if (best != i) {
-            swap(captures[i], captures[best]);
+            rotate(captures.begin() + i, captures.begin() + best, captures.begin() + best + 1);
         }
     }
 
@@ -452,12 +412,27 @@ void orderMoves(const Board &board, Movelist &ordered, const Move &bestfromprev
     }
 }
 
-int alphaBeta(Board &board, int depth, int alpha, int beta, Move &bestMove, const Move &bestfromprev = Move::NULL_MOVE){
+int alphaBeta(SearchBoard &board, int depth, int alpha, int beta, Move &bestMove, const Move &bestfromprev = Move::NULL_MOVE){
     
+    nodeCount++;
+    syncBoard(board);
     if (isTimeUp()) {
         timeUp = true;
         return evaluateBoard(board);
     }
+    if (stackPly + 1 >= MAX_SEARCH_PLY) {
+        return evaluateBoard(board);
+    }
+
+    // A repetition is scored as a draw, and a move back to an earlier
+    // position means the side to move can get at least a draw.
+    if (repetitions.isRepetition(board)) {
+        return 0;
+    }
+    if (alpha < 0 && repetitions.hasUpcomingRepetition(board, repetitions.size() - rootHistorySize)) {
+        alpha = 0;
+        if (alpha >= beta) return alpha;
+    }
     
     uint64_t currentPositionHash = board.hash();
     
@@ -486,11 +461,34 @@ int alphaBeta(Board &board, int depth, int alpha, int beta, Move &bestMove, cons
         }
     }
     
-    if (isCheckmate(board)) {
-        return -20000 + (6 - depth);
+    // WDL tables assume a fresh 50-move counter, so they are probed right
+    // after a capture or pawn move only. Every table win scores the same;
+    // once the root is in the tables, tbFilterRootMoves() picks the moves
+    // that make progress by DTZ.
+    if (board.halfMoveClock() == 0 && tbCanProbe(board)) {
+        TbWdl wdl;
+        if (tbProbeWdl(board, wdl)) {
+            if (wdl == TB_WIN) return TB_WIN_SCORE;
+            if (wdl == TB_LOSS) return -TB_WIN_SCORE;
+            return 0; // draws, and results the 50-move rule turns into draws
+        }
     }
-    if (isStalemate(board)) {
-        return 0;
+    
+    // The hash move is checked against the board instead of the generated
+    // moves, so it can be searched before generating anything; a move from a
+    // colliding entry or a stale bestfromprev is dropped. A legal hash move
+    // also means there is no mate or stalemate to look for.
+    if (hashMove != Move::NULL_MOVE && !board.isLegal(hashMove)) {
+        hashMove = Move::NULL_MOVE;
+    }
+    
+    if (hashMove == Move::NULL_MOVE) {
+        if (isCheckmate(board)) {
+            return -20000 + (6 - depth);
+        }
+        if (isStalemate(board)) {
+            return 0;
+        }
     }
     
     if (depth == 0) {
@@ -498,20 +496,37 @@ int alphaBeta(Board &board, int depth, int alpha, int beta, Move &bestMove, cons
     }
     
     Movelist moves;
-    orderMoves(board, moves, hashMove);
-
-    if (moves.empty()) {
-        return evaluateBoard(board);
+    if (hashMove != Move::NULL_MOVE) {
+        moves.add(hashMove);
     }
+    bool generated = false;
+    movegen::LegalityInfo legality{};
     
     bestMove = Move::NULL_MOVE;
+    Move firstSearched = Move::NULL_MOVE;
     int originalAlpha = alpha;
     
-    for (auto &m : moves) {
-        board.makeMove(m);
+    for (int i = 0; ; i++) {
+        // The other moves are only generated once the hash move has been
+        // searched without a cutoff.
+        if (i == (int)moves.size() && !generated) {
+            syncBoard(board);
+            orderMoves(board, moves, hashMove);
+            if (pseudoLegal) legality = movegen::legalityInfo(board);
+            generated = true;
+        }
+        if (i == (int)moves.size()) break;
+        
+        const Move m = moves[i];
+        if (generated && pseudoLegal) {
+            syncBoard(board);
+            if (!movegen::isLegal(board, legality, m)) continue;
+        }
+        if (firstSearched == Move::NULL_MOVE) firstSearched = m;
+        playMove(board, m);
         Move childBest;
         int score = -alphaBeta(board, depth - 1, -beta, -alpha, childBest);
-        board.unmakeMove(m);
+        takeBack(board, m);
         
         if (timeUp) {
             return alpha;
@@ -529,8 +544,11 @@ int alphaBeta(Board &board, int depth, int alpha, int beta, Move &bestMove, cons
         }
     }
 
-    if (bestMove == Move::NULL_MOVE && !moves.empty()) {
-        bestMove = moves[0];
+    if (firstSearched == Move::NULL_MOVE) {
+        return evaluateBoard(board);
+    }
+    if (bestMove == Move::NULL_MOVE) {
+        bestMove = firstSearched;
     }
     
     int boundType;
@@ -546,11 +564,8 @@ int alphaBeta(Board &board, int depth, int alpha, int beta, Move &bestMove, cons
     return alpha;
 }
 
-Move iterativedeep(Board &board, chrono::milliseconds timeMs)
+Move iterativedeep(SearchBoard &board, chrono::milliseconds timeMs, const Movelist &rootMoves, int maxDepth = 15)
 {
-    Movelist rootMoves;
-    movegen::legalmoves<>(rootMoves, board);
-    
     if(rootMoves.empty()) {
         return Move::NULL_MOVE;
     }
@@ -561,10 +576,17 @@ Move iterativedeep(Board &board, chrono::milliseconds timeMs)
     searchStartTime = chrono::steady_clock::now();
     timeLimit = timeMs;
     timeUp = false;
+    evalCount = 0;
+    lazyEvalExits = 0;
+    stackPly = 0;
+    loadedPly = 0;
+    positionStack[0] = board.position();
+    repetitions.reset(board);
+    rootHistorySize = repetitions.size();
     
     Move bestMove = rootMoves[0];
     
-    for (int depth = 1; depth <= 15; depth++)  
+    for (int depth = 1; depth <= maxDepth; depth++)  
     {
         if (isTimeUp()) break;  
         
@@ -573,10 +595,10 @@ Move iterativedeep(Board &board, chrono::milliseconds timeMs)
         
         for (auto &move : rootMoves) {
             if (move == bestMove) {
-                board.makeMove(move);
+                playMove(board, move);
                 Move dummy;
                 int score = -alphaBeta(board, depth - 1, -INF, INF, dummy);
-                board.unmakeMove(move);
+                takeBack(board, move);
                 
                 if (timeUp) break;
                 
@@ -592,10 +614,10 @@ Move iterativedeep(Board &board, chrono::milliseconds timeMs)
         
         for (auto &move : rootMoves) {
             if (move != bestMove) {
-                board.makeMove(move);
+                playMove(board, move);
                 Move dummy;
                 int score = -alphaBeta(board, depth - 1, -INF, INF, dummy);
-                board.unmakeMove(move);
+                takeBack(board, move);
                 
                 if (timeUp) break;
                 
@@ -615,9 +637,62 @@ Move iterativedeep(Board &board, chrono::milliseconds timeMs)
             break;
         }
     }
+    syncBoard(board);
     return bestMove;
 }
 
+// Positions for the bench command: openings and middlegames from common engine
+// bench sets, endgames, and mate puzzles from Week3.
+const char *const BENCH_FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "rnbqkb1r/pp1p1ppp/4pn2/2p5/2PP4/2N5/PP2PPPP/R1BQKBNR w KQkq - 0 4",
+    "r1bq1rk1/ppp1nppb/4p2p/3pP3/3P3P/2PB4/P1P1NPP1/R2QK2R w KQ - 1 11",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "4r1rk/5K1b/7R/R7/8/8/8/8 w - - 0 1",
+    "1r3r1k/6p1/p6p/2bpNBP1/1p2n3/1P5Q/PBP1q2P/1K5R w - - 1 0",
+    "r5rk/2p1Nppp/3p3P/pp2p1P1/4P3/2qnPQK1/8/R6R w - - 1 0",
+};
+
+// Searches every bench position to a fixed depth with no time limit, clearing
+// the transposition table before each one, and prints the total nodes. With
+// no tablebases loaded the node count depends only on the search and eval, so
+// it works as a signature of a build as well as a speed test. The search is
+// single-threaded; `hashMb` only pre-sizes the table.
+void bench(int depth, int threads, size_t hashMb)
+{
+    if (threads > 1) {
+        std::cout << "info string search is single-threaded, running bench on 1 thread" << endl;
+    }
+    std::cout << "info string slider attacks " << attacks::sliderBackendName(attacks::sliderBackend()) << endl;
+    uint64_t totalNodes = 0;
+    auto start = chrono::steady_clock::now();
+    int index = 0;
+    for (const char *fen : BENCH_FENS) {
+        SearchBoard board(fen);
+        clearHashTable();
+        hashTable.reserve(hashMb * 1024 * 1024 / (sizeof(uint64_t) + sizeof(TranspositionEntry) + 2 * sizeof(void *)));
+        Movelist rootMoves;
+        movegen::legalmoves<>(rootMoves, board);
+        nodeCount = 0;
+        Move best = iterativedeep(board, chrono::milliseconds::max(), rootMoves, depth);
+        totalNodes += nodeCount;
+        std::cout << "position " << ++index << ": " << fen << "\n  bestmove " << uci::moveToUci(best)
+                  << " nodes " << nodeCount << endl;
+    }
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    clearHashTable();
+    std::cout << "===========================" << "\n"
+              << "Total time (ms) : " << elapsed << "\n"
+              << "Nodes searched  : " << totalNodes << "\n"
+              << "Nodes/second    : " << totalNodes * 1000 / max<int64_t>(elapsed, 1) << endl;
+}
+
 vector<string> splitString(const string& str, char delimiter) {
     vector<string> tokens;
     stringstream ss(str);
@@ -630,12 +705,40 @@ vector<string> splitString(const string& str, char delimiter) {
     return tokens;
 }
 
-int main() {
+// bench [depth] [threads] [hashMB] [copymake] [pseudolegal], from the
+// command line or the UCI loop. A trailing "copymake" runs it with copy-make
+// instead of make/unmake and "pseudolegal" with pseudo-legal generation; the
+// node count must come out the same.
+void benchCommand(vector<string> args)
+{
+    bool savedCopyMake = copyMake, savedPseudoLegal = pseudoLegal;
+    while (args.size() > 1 && (args.back() == "copymake" || args.back() == "pseudolegal")) {
+        (args.back() == "copymake" ? copyMake : pseudoLegal) = true;
+        args.pop_back();
+    }
+    try {
+        int depth = args.size() > 1 ? stoi(args[1]) : 4;
+        int threads = args.size() > 2 ? stoi(args[2]) : 1;
+        size_t hashMb = args.size() > 3 ? stoul(args[3]) : 16;
+        bench(max(1, depth), threads, hashMb);
+    } catch (...) {
+        std::cout << "info string usage: bench [depth] [threads] [hashMB] [copymake] [pseudolegal]" << endl;
+    }
+    copyMake = savedCopyMake;
+    pseudoLegal = savedPseudoLegal;
+}
+
+int main(int argc, char **argv) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
     std::cout.tie(nullptr);
     
-    Board board;
+    if (argc > 1 && string(argv[1]) == "bench") {
+        benchCommand(vector<string>(argv + 1, argv + argc));
+        return 0;
+    }
+
+    SearchBoard board;
     string line;
     
     while (getline(cin, line)) {
@@ -649,9 +752,31 @@ int main() {
         if (line == "uci") {
             std::cout << "id name Aethi" << endl;
             std::cout << "id author Atharva" << endl;
+            std::cout << "option name SyzygyPath type string default <empty>" << endl;
+            std::cout << "option name CopyMake type check default false" << endl;
+            std::cout << "option name PseudoLegal type check default false" << endl;
             std::cout << "uciok" << endl;
             std::cout.flush();
         }
+        else if (line.substr(0, 9) == "setoption") {
+            vector<string> tokens = splitString(line, ' ');
+            if (tokens.size() >= 5 && tokens[1] == "name" && tokens[2] == "SyzygyPath" && tokens[3] == "value") {
+                string path = line.substr(line.find(" value ") + 7);
+                if (path == "<empty>") {
+                    tbFree();
+                } else {
+                    int loaded = tbInit(path);
+                    std::cout << "info string found " << loaded << " Syzygy tables, up to " << tbLargest << " pieces"
+                              << endl;
+                }
+            }
+            else if (tokens.size() >= 5 && tokens[1] == "name" && tokens[2] == "CopyMake" && tokens[3] == "value") {
+                copyMake = tokens[4] == "true";
+            }
+            else if (tokens.size() >= 5 && tokens[1] == "name" && tokens[2] == "PseudoLegal" && tokens[3] == "value") {
+                pseudoLegal = tokens[4] == "true";
+            }
+        }
         else if (line == "isready") {
             std::cout << "readyok" << endl;
             std::cout.flush();
@@ -754,21 +879,68 @@ int main() {
                 continue;
             }
             
+            tbHits = 0;
+            if (tbFilterRootMoves(board, rootMoves)) {
+                std::cout << "info string tablebase root filter kept " << rootMoves.size() << " moves" << endl;
+            }
+            
             if (rootMoves.size() == 1) {
                 std::cout << "bestmove " << uci::moveToUci(rootMoves[0]) << endl;
                 std::cout.flush();
                 continue;
             }
 
-            Move bestMove = iterativedeep(board, searchTime);
+            Move bestMove = iterativedeep(board, searchTime, rootMoves);
             
             if (bestMove == Move::NULL_MOVE) {
                 bestMove = rootMoves[0];
             }
             
+            if (evalCount > 0) {
+                std::cout << "info string lazy eval exits " << lazyEvalExits << "/" << evalCount
+                          << " (" << (100.0 * lazyEvalExits / evalCount) << "%)" << endl;
+            }
+            if (tbHits > 0) {
+                std::cout << "info string tbhits " << tbHits << endl;
+            }
+            
             std::cout << "bestmove " << uci::moveToUci(bestMove) << endl;
             std::cout.flush();
         }
+        else if (line == "bench" || line.substr(0, 6) == "bench ") {
+            benchCommand(splitString(line, ' '));
+        }
+        else if (line.substr(0, 5) == "perft" || line.substr(0, 6) == "divide") {
+            // perft|divide <depth> [threads <n>] [hash <MB>]: leaf count of the
+            // current position, split over the root moves for divide.
+            vector<string> tokens = splitString(line, ' ');
+            int depth = 1, threads = max(1u, thread::hardware_concurrency());
+            size_t hashMb = 0;
+            try {
+                if (tokens.size() > 1) depth = stoi(tokens[1]);
+                for (size_t i = 2; i + 1 < tokens.size(); i += 2) {
+                    if (tokens[i] == "threads") threads = max(1, stoi(tokens[i + 1]));
+                    else if (tokens[i] == "hash") hashMb = stoul(tokens[i + 1]);
+                }
+            } catch (...) {
+                std::cout << "info string usage: " << tokens[0] << " <depth> [threads <n>] [hash <MB>]" << endl;
+                continue;
+            }
+            unique_ptr<PerftTable> table;
+            if (hashMb > 0) table.reset(new PerftTable(hashMb));
+
+            vector<pair<Move, uint64_t>> counts;
+            auto perftStart = chrono::steady_clock::now();
+            uint64_t nodes = divide(board, depth, threads, table.get(), counts);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - perftStart).count();
+            if (tokens[0] == "divide") {
+                for (const auto &c : counts) {
+                    std::cout << uci::moveToUci(c.first) << ": " << c.second << "\n";
+                }
+                std::cout << "\n";
+            }
+            std::cout << "nodes " << nodes << " time " << (uint64_t)ms << " ms " << perftMnps(nodes, ms) << " Mnps" << endl;
+        }
         else if (line == "quit") {
             break;
         }
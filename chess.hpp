@@ -37,8 +37,20 @@ VERSION: 0.8.2
 
 
 #include <cstdint>
+#include <cstring>
+#include <new>
 #ifdef CHESS_USE_PEXT
 #    include <immintrin.h>
+#elif !defined(CHESS_NO_PEXT_DISPATCH) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// Portable x86-64 builds carry both slider backends and pick PEXT at startup
+// when the CPU has a fast one, see attacks::sliderBackend().
+#    define CHESS_PEXT_DISPATCH
+#    include <cpuid.h>
+#endif
+#if !defined(CHESS_NO_BATCH_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// PositionBatch carries AVX2 and AVX-512 kernels next to the scalar one and
+// picks one at runtime, see PositionBatch::bestKernel().
+#    define CHESS_BATCH_SIMD
 #endif
 
 
@@ -942,32 +954,184 @@ class Piece {
 }  // namespace chess
 
 namespace chess {
+namespace detail {
+// Generators for the slider and between tables. They are constexpr so that
+// the tables can be built by the compiler: always for the small between
+// table, and for the slider tables when CHESS_CONSTEXPR_TABLES is defined,
+// which costs a few seconds of compile time per translation unit (GCC; other
+// compilers may need a higher constexpr step limit) and leaves no table work
+// at startup. Without it attacks::initAttacks() runs the same code at startup.
+
+inline constexpr int ROOK_ATTACKS_SIZE   = 0x19000;
+inline constexpr int BISHOP_ATTACKS_SIZE = 0x1480;
+
+#ifdef CHESS_USE_PEXT
+inline constexpr bool MAGIC_SLIDERS = false;
+#else
+inline constexpr bool MAGIC_SLIDERS = true;
+#endif
+#if defined(CHESS_USE_PEXT) || defined(CHESS_PEXT_DISPATCH)
+inline constexpr bool PEXT_SLIDERS = true;
+#else
+inline constexpr bool PEXT_SLIDERS = false;
+#endif
+
+// The squares a rook or bishop on sq reaches in direction dir on an empty
+// board, nearest first; returns their number.
+constexpr int sliderRay(bool rook, int sq, int dir, int squares[7]) noexcept {
+    constexpr int dirs[2][4][2] = {{{1, 1}, {1, -1}, {-1, -1}, {-1, 1}}, {{1, 0}, {0, -1}, {-1, 0}, {0, 1}}};
+
+    const int df = dirs[rook][dir][0], dr = dirs[rook][dir][1];
+    int n        = 0;
+    for (int f = sq % 8 + df, r = sq / 8 + dr; f >= 0 && f < 8 && r >= 0 && r < 8; f += df, r += dr) {
+        squares[n++] = r * 8 + f;
+    }
+    return n;
+}
+
+// The occupancy bits the attacks of a slider on sq depend on: every ray
+// square but the last, which is attacked whether it is occupied or not.
+constexpr std::uint64_t sliderMask(bool rook, int sq) noexcept {
+    std::uint64_t mask = 0;
+    for (int dir = 0; dir < 4; dir++) {
+        int squares[7] = {};
+        const int n    = sliderRay(rook, sq, dir, squares);
+        for (int i = 0; i < n - 1; i++) mask |= 1ULL << squares[i];
+    }
+    return mask;
+}
+
+// The slider attack tables of one piece type. `magic` is indexed by the magic
+// multiply and `pext` by PEXT of the occupancy; a build has the ones its
+// backends use, see attacks::sliderBackend().
+template <int SIZE>
+struct SliderAttacks {
+    Bitboard magic[MAGIC_SLIDERS ? SIZE : 1];
+    Bitboard pext[PEXT_SLIDERS ? SIZE : 1];
+};
+
+// Fills the attacks of a rook or bishop for every relevant occupancy of
+// every square, 2^bits entries per square from a1 on. Either table may be
+// null. The four rays block independently, so the subsets of each ray and
+// the attacks they leave are listed once and every occupancy is the union of
+// one subset per ray; its PEXT index is the sum of the rays' PEXT indices.
+template <bool ROOK>
+constexpr void fillSliderAttacks(const std::uint64_t *magics, Bitboard *magic_attacks,
+                                 Bitboard *pext_attacks) noexcept {
+    int offset = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        const std::uint64_t mask = sliderMask(ROOK, sq);
+        int bits                 = 0;
+        for (auto m = mask; m; m &= m - 1) bits++;
+
+        std::uint64_t occ[4][64] = {}, att[4][64] = {}, index[4][64] = {};
+        int subsets[4]           = {};
+        for (int dir = 0; dir < 4; dir++) {
+            int squares[7]     = {};
+            const int n        = sliderRay(ROOK, sq, dir, squares);
+            const int relevant = n > 0 ? n - 1 : 0;
+            subsets[dir]       = 1 << relevant;
+
+            for (int s = 0; s < subsets[dir]; s++) {
+                for (int i = 0; i < n; i++) {
+                    att[dir][s] |= 1ULL << squares[i];
+                    if (i < relevant && (s >> i & 1)) break;
+                }
+                for (int i = 0; i < relevant; i++) {
+                    if (s >> i & 1) occ[dir][s] |= 1ULL << squares[i];
+                }
+                int bit = 0;
+                for (auto m = mask; m; m &= m - 1, bit++) {
+                    if (occ[dir][s] & m & (0 - m)) index[dir][s] |= 1ULL << bit;
+                }
+            }
+        }
+
+        for (int a = 0; a < subsets[0]; a++) {
+            for (int b = 0; b < subsets[1]; b++) {
+                for (int c = 0; c < subsets[2]; c++) {
+                    const auto occ3 = occ[0][a] | occ[1][b] | occ[2][c];
+                    const auto att3 = att[0][a] | att[1][b] | att[2][c];
+                    const auto idx3 = index[0][a] + index[1][b] + index[2][c];
+                    for (int d = 0; d < subsets[3]; d++) {
+                        const auto o = occ3 | occ[3][d];
+                        if (magic_attacks)
+                            magic_attacks[offset + ((o * magics[sq]) >> (64 - bits))] = att3 | att[3][d];
+                        if (pext_attacks) pext_attacks[offset + idx3 + index[3][d]] = att3 | att[3][d];
+                    }
+                }
+            }
+        }
+
+        offset += 1 << bits;
+    }
+}
+
+template <bool ROOK, int SIZE>
+constexpr SliderAttacks<SIZE> makeSliderAttacks(const std::uint64_t *magics) noexcept {
+    SliderAttacks<SIZE> tables{};
+    fillSliderAttacks<ROOK>(magics, MAGIC_SLIDERS ? tables.magic : nullptr, PEXT_SLIDERS ? tables.pext : nullptr);
+    return tables;
+}
+
+// The squares between two squares on a line, and the second square itself
+// (also when they are not on a line), as movegen::between() returns them.
+constexpr std::array<std::array<Bitboard, 64>, 64> makeSquaresBetween() noexcept {
+    std::array<std::array<Bitboard, 64>, 64> between{};
+
+    for (int sq1 = 0; sq1 < 64; sq1++) {
+        for (bool rook : {false, true}) {
+            for (int dir = 0; dir < 4; dir++) {
+                int squares[7]      = {};
+                const int n         = sliderRay(rook, sq1, dir, squares);
+                std::uint64_t inner = 0;
+                for (int i = 0; i < n; i++) {
+                    between[sq1][squares[i]] = Bitboard(inner);
+                    inner |= 1ULL << squares[i];
+                }
+            }
+        }
+        for (int sq2 = 0; sq2 < 64; sq2++) between[sq1][sq2] = Bitboard(between[sq1][sq2].getBits() | 1ULL << sq2);
+    }
+
+    return between;
+}
+}  // namespace detail
+
 class attacks {
     using U64 = std::uint64_t;
 
 #ifdef CHESS_USE_PEXT
     struct Magic {
         U64 mask;
-        Bitboard *attacks;
+        const Bitboard *attacks;
         U64 operator()(Bitboard b) const noexcept { return _pext_u64(b.getBits(), mask); }
     };
 #else
     struct Magic {
         U64 mask;
         U64 magic;
-        Bitboard *attacks;
+        const Bitboard *attacks;
         U64 shift;
+#    ifdef CHESS_PEXT_DISPATCH
+        const Bitboard *pext_attacks;
+
+        // pext in inline asm rather than _pext_u64, which needs the whole
+        // translation unit built with -mbmi2; only run when the CPU has BMI2
+        U64 pext(Bitboard b) const noexcept {
+            U64 index;
+            asm("pextq %2, %1, %0" : "=r"(index) : "r"(b.getBits()), "r"(mask));
+            return index;
+        }
+#    endif
         U64 operator()(Bitboard b) const noexcept { return (((b & mask)).getBits() * magic) >> shift; }
     };
 #endif
 
-    // Slow function to calculate bishop and rook attacks
-    template <bool ISROOK>
-    [[nodiscard]] static Bitboard sliderAttacks(Square sq, Bitboard occupied) noexcept;
-
-    // Initializes the magic bitboard tables for sliding pieces
-    static void initSliders(Square sq, Magic table[], U64 magic,
-                            const std::function<Bitboard(Square, Bitboard)> &attacks);
+    // Points the lookup of a square into its part of the attack tables
+    template <bool ROOK, int SIZE>
+    static void initSliders(Square sq, Magic &entry, U64 magic, const detail::SliderAttacks<SIZE> &tables,
+                            int &offset);
 
     // clang-format off
     // pre-calculated lookup table for pawn attacks
@@ -1080,13 +1244,57 @@ class attacks {
         0xa010109502200ULL,    0x4a02012000ULL,       0x500201010098b028ULL, 0x8040002811040900ULL,
         0x28000010020204ULL,   0x6000020202d0240ULL,  0x8918844842082200ULL, 0x4010011029020020ULL};
 
-    static inline Bitboard RookAttacks[0x19000]  = {};
-    static inline Bitboard BishopAttacks[0x1480] = {};
+#ifdef CHESS_CONSTEXPR_TABLES
+    static constexpr auto RookAttacks =
+        detail::makeSliderAttacks<true, detail::ROOK_ATTACKS_SIZE>(RookMagics);
+    static constexpr auto BishopAttacks =
+        detail::makeSliderAttacks<false, detail::BISHOP_ATTACKS_SIZE>(BishopMagics);
+#else
+    // Filled by initAttacks; the PEXT ones of a dispatching build only if the
+    // CPU has BMI2
+    static inline detail::SliderAttacks<detail::ROOK_ATTACKS_SIZE> RookAttacks     = {};
+    static inline detail::SliderAttacks<detail::BISHOP_ATTACKS_SIZE> BishopAttacks = {};
+#endif
 
     static inline Magic RookTable[64]   = {};
     static inline Magic BishopTable[64] = {};
 
+    static const bool initialized_;
+
+#ifdef CHESS_PEXT_DISPATCH
+    static inline bool use_pext_ = false;
+
+    [[nodiscard]] static bool cpuHasFastPext() noexcept;
+#endif
+
    public:
+    enum class SliderBackend : std::uint8_t { MAGIC, PEXT };
+
+    /**
+     * @brief The backend the bishop/rook/queen lookups use. Built with
+     * CHESS_USE_PEXT that is always PEXT. A portable x86-64 build (the
+     * default, unless CHESS_NO_PEXT_DISPATCH is defined) has both and picks
+     * PEXT at startup if the CPU has BMI2 and it is fast, i.e. not an AMD
+     * CPU before Zen 3, which runs PEXT in microcode. Elsewhere it is MAGIC.
+     */
+    [[nodiscard]] static SliderBackend sliderBackend() noexcept;
+
+    /**
+     * @brief Whether this build can use the backend on this CPU.
+     */
+    [[nodiscard]] static bool hasSliderBackend(SliderBackend backend) noexcept;
+
+    /**
+     * @brief Switches the slider backend, e.g. to compare them. Returns false
+     * and keeps the current one if hasSliderBackend(backend) is false. Not
+     * safe while other threads generate moves.
+     */
+    static bool setSliderBackend(SliderBackend backend) noexcept;
+
+    [[nodiscard]] static const char *sliderBackendName(SliderBackend backend) noexcept {
+        return backend == SliderBackend::PEXT ? "pext" : "magic";
+    }
+
     static constexpr Bitboard MASK_RANK[8] = {0xff,         0xff00,         0xff0000,         0xff000000,
                                               0xff00000000, 0xff0000000000, 0xff000000000000, 0xff00000000000000};
 
@@ -1197,6 +1405,7 @@ class attacks {
 #include <array>
 #include <cctype>
 #include <optional>
+#include <type_traits>
 
 // check if charconv header is available
 #if __has_include(<charconv>)
@@ -1434,7 +1643,12 @@ class Board;
 
 class movegen {
    public:
-    enum class MoveGenType : std::uint8_t { ALL, CAPTURE, QUIET };
+    /**
+     * EVASIONS is for a side in check: the king moves and, in single check,
+     * the captures of the checker and the blocks, in one pass and in the
+     * order of ALL. Out of check it is ALL without castling.
+     */
+    enum class MoveGenType : std::uint8_t { ALL, CAPTURE, QUIET, EVASIONS };
 
     /**
      * @brief Generates all legal moves for a position.
@@ -1448,9 +1662,40 @@ class movegen {
                            int pieces = PieceGenType::PAWN | PieceGenType::KNIGHT | PieceGenType::BISHOP |
                                         PieceGenType::ROOK | PieceGenType::QUEEN | PieceGenType::KING);
 
+    /**
+     * @brief Generates pseudo-legal moves: the moves of legalmoves() plus the
+     * ones that leave the own king in check, move it into check or castle out
+     * of or through check. No check or pin masks are computed, so a search
+     * that cuts off after a few moves only pays for the legality of those:
+     * test each one with isLegal() before making it. In the same order as
+     * legalmoves() with the illegal moves left in.
+     */
+    template <MoveGenType mt = MoveGenType::ALL>
+    void static pseudolegalmoves(Movelist &movelist, const Board &board,
+                                 int pieces = PieceGenType::PAWN | PieceGenType::KNIGHT | PieceGenType::BISHOP |
+                                              PieceGenType::ROOK | PieceGenType::QUEEN | PieceGenType::KING);
+
+    /**
+     * @brief What isLegal() needs to know about a position, computed once for
+     * all of its moves: the king of the side to move, the pieces giving check
+     * and the pieces of the side to move pinned to their king.
+     */
+    struct LegalityInfo {
+        Square king;
+        Bitboard checkers;
+        Bitboard pinned;
+    };
+
+    [[nodiscard]] static LegalityInfo legalityInfo(const Board &board) noexcept;
+
+    /**
+     * @brief Whether a pseudo-legal move of the side to move, e.g. one from
+     * pseudolegalmoves(), is legal. `info` must be legalityInfo(board).
+     */
+    [[nodiscard]] static bool isLegal(const Board &board, const LegalityInfo &info, Move move) noexcept;
+
    private:
-    static auto init_squares_between();
-    static const std::array<std::array<Bitboard, 64>, 64> SQUARES_BETWEEN_BB;
+    static constexpr std::array<std::array<Bitboard, 64>, 64> SQUARES_BETWEEN_BB = detail::makeSquaresBetween();
 
     // Generate the checkmask. Returns a bitboard where the attacker path between the king and enemy piece is set.
     template <Color::underlying c>
@@ -1493,6 +1738,13 @@ class movegen {
     template <Color::underlying c, MoveGenType mt>
     static void legalmoves(Movelist &movelist, const Board &board, int pieces);
 
+    template <Color::underlying c, MoveGenType mt>
+    static void pseudolegalmoves(Movelist &movelist, const Board &board, int pieces);
+
+    // Whether `color` attacks sq when only the squares in occ are occupied;
+    // pieces of `color` outside occ count as captured.
+    [[nodiscard]] static bool isAttacked(const Board &board, Color color, Square sq, Bitboard occ) noexcept;
+
     template <Color::underlying c>
     static bool isEpSquareValid(const Board &board, Square ep);
 
@@ -1716,6 +1968,7 @@ class Zobrist {
 
    public:
     friend class Board;
+    friend class RepetitionHistory;
 };
 
 }  // namespace chess
@@ -1821,6 +2074,23 @@ class Board {
         std::array<std::array<File, 2>, 2> rooks;
     };
 
+    /**
+     * @brief The state of a Board without its history, trivially copyable, for
+     * copy-make searches: doMove() writes the position after a move into a new
+     * Position and the old one stays as it was, so nothing needs undoing.
+     */
+    struct Position {
+        std::array<Bitboard, 6> pieces;
+        std::array<Bitboard, 2> occ;
+        std::array<Piece, 64> board;
+        U64 key;
+        CastlingRights castling;
+        Square enpassant;
+        Color stm;
+        std::uint8_t half_moves;
+        std::uint16_t plies;
+    };
+
    private:
     struct State {
         U64 hash;
@@ -1838,6 +2108,53 @@ class Board {
               captured_piece(captured_piece) {}
     };
 
+    // History of the states to unmake to, stored inline with a fixed capacity
+    // (a long game plus a deep search), so make/unmake never allocate and a
+    // board copy copies only the live entries. A game longer than CAPACITY
+    // plies drops its oldest half: those states were only needed to unmake
+    // that far back, and repetitions never look past the last irreversible move.
+    class StateStack {
+       public:
+        static constexpr int CAPACITY = 1024;
+
+        StateStack() = default;
+        StateStack(const StateStack &other) : size_(other.size_) { copyFrom(other); }
+        StateStack &operator=(const StateStack &other) {
+            size_ = other.size_;
+            copyFrom(other);
+            return *this;
+        }
+
+        template <typename... Args>
+        void emplace_back(Args &&...args) {
+            if (size_ == CAPACITY) {
+                std::memmove(static_cast<void *>(slots_), slots_ + CAPACITY / 2, CAPACITY / 2 * sizeof(Slot));
+                size_ = CAPACITY / 2;
+            }
+            new (&slots_[size_++].state) State(std::forward<Args>(args)...);
+        }
+
+        const State &back() const noexcept { return slots_[size_ - 1].state; }
+        void pop_back() noexcept { size_--; }
+        const State &operator[](int i) const noexcept { return slots_[i].state; }
+        int size() const noexcept { return size_; }
+        void clear() noexcept { size_ = 0; }
+
+       private:
+        // Left uninitialized until pushed.
+        union Slot {
+            State state;
+            Slot() {}
+        };
+
+        void copyFrom(const StateStack &other) {
+            if (this != &other) std::memcpy(static_cast<void *>(slots_), other.slots_, size_ * sizeof(Slot));
+        }
+
+        Slot slots_[CAPACITY];
+        int size_ = 0;
+    };
+
     enum class PrivateCtor { CREATE };
 
     // private constructor to avoid initialization
@@ -1845,7 +2162,6 @@ class Board {
 
    public:
     explicit Board(std::string_view fen = constants::STARTPOS, bool chess960 = false) {
-        prev_states_.reserve(256);
         chess960_ = chess960;
         assert(setFenInternal<true>(constants::STARTPOS));
         setFenInternal<true>(fen);
@@ -2009,6 +2325,33 @@ class Board {
      */
     template <bool EXACT = false>
     void makeMove(const Move move) {
+        makeMoveImpl<EXACT, true>(move);
+    }
+
+    void unmakeMove(const Move move) { unmakeMoveImpl<true>(move); }
+
+   protected:
+    // The move code with the piece placement hooks (HOOKS = true, the virtual
+    // placePiece/removePiece) or without them (HOOKS = false, direct calls that
+    // the compiler can inline). SearchBoard uses the latter.
+    template <bool HOOKS>
+    void placePieceAs(Piece piece, Square sq) {
+        if constexpr (HOOKS)
+            placePiece(piece, sq);
+        else
+            placePieceInternal(piece, sq);
+    }
+
+    template <bool HOOKS>
+    void removePieceAs(Piece piece, Square sq) {
+        if constexpr (HOOKS)
+            removePiece(piece, sq);
+        else
+            removePieceInternal(piece, sq);
+    }
+
+    template <bool EXACT, bool HOOKS>
+    void makeMoveImpl(const Move move) {
         const auto capture  = at(move.to()) != Piece::NONE && move.typeOf() != Move::CASTLING;
         const auto captured = at(move.to());
         const auto pt       = at<PieceType>(move.from());
@@ -2025,7 +2368,7 @@ class Board {
         ep_sq_ = Square::NO_SQ;
 
         if (capture) {
-            removePiece(captured, move.to());
+            removePieceAs<HOOKS>(captured, move.to());
 
             hfm_ = 0;
             key_ ^= Zobrist::piece(captured, move.to());
@@ -2114,14 +2457,14 @@ class Board {
             const auto king = at(move.from());
             const auto rook = at(move.to());
 
-            removePiece(king, move.from());
-            removePiece(rook, move.to());
+            removePieceAs<HOOKS>(king, move.from());
+            removePieceAs<HOOKS>(rook, move.to());
 
             assert(king == Piece(PieceType::KING, stm_));
             assert(rook == Piece(PieceType::ROOK, stm_));
 
-            placePiece(king, kingTo);
-            placePiece(rook, rookTo);
+            placePieceAs<HOOKS>(king, kingTo);
+            placePieceAs<HOOKS>(rook, rookTo);
 
             key_ ^= Zobrist::piece(king, move.from()) ^ Zobrist::piece(king, kingTo);
             key_ ^= Zobrist::piece(rook, move.to()) ^ Zobrist::piece(rook, rookTo);
@@ -2129,8 +2472,8 @@ class Board {
             const auto piece_pawn = Piece(PieceType::PAWN, stm_);
             const auto piece_prom = Piece(move.promotionType(), stm_);
 
-            removePiece(piece_pawn, move.from());
-            placePiece(piece_prom, move.to());
+            removePieceAs<HOOKS>(piece_pawn, move.from());
+            placePieceAs<HOOKS>(piece_prom, move.to());
 
             key_ ^= Zobrist::piece(piece_pawn, move.from()) ^ Zobrist::piece(piece_prom, move.to());
         } else {
@@ -2139,8 +2482,8 @@ class Board {
 
             const auto piece = at(move.from());
 
-            removePiece(piece, move.from());
-            placePiece(piece, move.to());
+            removePieceAs<HOOKS>(piece, move.from());
+            placePieceAs<HOOKS>(piece, move.to());
 
             key_ ^= Zobrist::piece(piece, move.from()) ^ Zobrist::piece(piece, move.to());
         }
@@ -2150,7 +2493,7 @@ class Board {
 
             const auto piece = Piece(PieceType::PAWN, ~stm_);
 
-            removePiece(piece, move.to().ep_square());
+            removePieceAs<HOOKS>(piece, move.to().ep_square());
 
             key_ ^= Zobrist::piece(piece, move.to().ep_square());
         }
@@ -2159,7 +2502,8 @@ class Board {
         stm_ = ~stm_;
     }
 
-    void unmakeMove(const Move move) {
+    template <bool HOOKS>
+    void unmakeMoveImpl(const Move move) {
         const auto &prev = prev_states_.back();
 
         ep_sq_ = prev.enpassant;
@@ -2179,14 +2523,14 @@ class Board {
             const auto rook = at(rook_from_sq);
             const auto king = at(king_to_sq);
 
-            removePiece(rook, rook_from_sq);
-            removePiece(king, king_to_sq);
+            removePieceAs<HOOKS>(rook, rook_from_sq);
+            removePieceAs<HOOKS>(king, king_to_sq);
 
             assert(king == Piece(PieceType::KING, stm_));
             assert(rook == Piece(PieceType::ROOK, stm_));
 
-            placePiece(king, move.from());
-            placePiece(rook, move.to());
+            placePieceAs<HOOKS>(king, move.from());
+            placePieceAs<HOOKS>(rook, move.to());
 
         } else if (move.typeOf() == Move::PROMOTION) {
             const auto pawn  = Piece(PieceType::PAWN, stm_);
@@ -2197,12 +2541,12 @@ class Board {
             assert(piece.type() != PieceType::KING);
             assert(piece.type() != PieceType::NONE);
 
-            removePiece(piece, move.to());
-            placePiece(pawn, move.from());
+            removePieceAs<HOOKS>(piece, move.to());
+            placePieceAs<HOOKS>(pawn, move.from());
 
             if (prev.captured_piece != Piece::NONE) {
                 assert(at(move.to()) == Piece::NONE);
-                placePiece(prev.captured_piece, move.to());
+                placePieceAs<HOOKS>(prev.captured_piece, move.to());
             }
 
         } else {
@@ -2211,8 +2555,8 @@ class Board {
 
             const auto piece = at(move.to());
 
-            removePiece(piece, move.to());
-            placePiece(piece, move.from());
+            removePieceAs<HOOKS>(piece, move.to());
+            placePieceAs<HOOKS>(piece, move.from());
 
             if (move.typeOf() == Move::ENPASSANT) {
                 const auto pawn   = Piece(PieceType::PAWN, ~stm_);
@@ -2220,11 +2564,11 @@ class Board {
 
                 assert(at(pawnTo) == Piece::NONE);
 
-                placePiece(pawn, pawnTo);
+                placePieceAs<HOOKS>(pawn, pawnTo);
             } else if (prev.captured_piece != Piece::NONE) {
                 assert(at(move.to()) == Piece::NONE);
 
-                placePiece(prev.captured_piece, move.to());
+                placePieceAs<HOOKS>(prev.captured_piece, move.to());
             }
         }
 
@@ -2232,6 +2576,8 @@ class Board {
         prev_states_.pop_back();
     }
 
+   public:
+
     /**
      * @brief Make a null move. (Switches the side to move)
      */
@@ -2265,6 +2611,114 @@ class Board {
         prev_states_.pop_back();
     }
 
+    /**
+     * @brief The current position without the move history.
+     */
+    [[nodiscard]] Position position() const noexcept {
+        return {pieces_bb_, occ_bb_, board_, key_, cr_, ep_sq_, stm_, hfm_, plies_};
+    }
+
+    /**
+     * @brief Replaces the current position, e.g. with one made by doMove().
+     * The move history is left as it is, so repetition detection does not see
+     * the moves that led from the history to this position.
+     */
+    void setPosition(const Position &pos) noexcept {
+        pieces_bb_ = pos.pieces;
+        occ_bb_    = pos.occ;
+        board_     = pos.board;
+        key_       = pos.key;
+        cr_        = pos.castling;
+        ep_sq_     = pos.enpassant;
+        stm_       = pos.stm;
+        hfm_       = pos.half_moves;
+        plies_     = pos.plies;
+    }
+
+    /**
+     * @brief Copy-make: writes the position after a legal move into `to`.
+     * Gives the same position and hash as makeMove<false>(), including
+     * recording the en passant square whenever an enemy pawn attacks it.
+     * Castling follows the standard rook and king squares, as makeMove does.
+     */
+    static void doMove(const Position &from, const Move move, Position &to) noexcept {
+        to = from;
+
+        const auto us       = from.stm;
+        const auto piece    = from.board[move.from().index()];
+        const auto captured = from.board[move.to().index()];
+        const auto capture  = captured != Piece::NONE && move.typeOf() != Move::CASTLING;
+
+        auto remove = [&to](Piece p, Square sq) {
+            to.pieces[p.type()].clear(sq.index());
+            to.occ[p.color()].clear(sq.index());
+            to.board[sq.index()] = Piece::NONE;
+            to.key ^= Zobrist::piece(p, sq);
+        };
+        auto place = [&to](Piece p, Square sq) {
+            to.pieces[p.type()].set(sq.index());
+            to.occ[p.color()].set(sq.index());
+            to.board[sq.index()] = p;
+            to.key ^= Zobrist::piece(p, sq);
+        };
+        auto kingSq = [&from](Color c) { return (from.pieces[PieceType(PieceType::KING)] & from.occ[c]).lsb(); };
+
+        to.half_moves++;
+        to.plies++;
+
+        if (to.enpassant != Square::NO_SQ) to.key ^= Zobrist::enpassant(to.enpassant.file());
+        to.enpassant = Square::NO_SQ;
+
+        if (capture) {
+            remove(captured, move.to());
+            to.half_moves = 0;
+
+            if (captured.type() == PieceType::ROOK && Rank::back_rank(move.to().rank(), ~us)) {
+                const auto side = CastlingRights::closestSide(move.to(), Square(kingSq(~us)));
+                if (to.castling.getRookFile(~us, side) == move.to().file()) {
+                    to.key ^= Zobrist::castlingIndex(to.castling.clear(~us, side));
+                }
+            }
+        }
+
+        if (piece.type() == PieceType::KING && to.castling.has(us)) {
+            to.key ^= Zobrist::castling(to.castling.hashIndex());
+            to.castling.clear(us);
+            to.key ^= Zobrist::castling(to.castling.hashIndex());
+        } else if (piece.type() == PieceType::ROOK && Square::back_rank(move.from(), us)) {
+            const auto side = CastlingRights::closestSide(move.from(), Square(kingSq(us)));
+            if (to.castling.getRookFile(us, side) == move.from().file()) {
+                to.key ^= Zobrist::castlingIndex(to.castling.clear(us, side));
+            }
+        } else if (piece.type() == PieceType::PAWN) {
+            to.half_moves = 0;
+            if (Square::value_distance(move.to(), move.from()) == 16 &&
+                (attacks::pawn(us, move.to().ep_square()) & from.pieces[PieceType(PieceType::PAWN)] & from.occ[~us])) {
+                to.enpassant = move.to().ep_square();
+                to.key ^= Zobrist::enpassant(to.enpassant.file());
+            }
+        }
+
+        if (move.typeOf() == Move::CASTLING) {
+            const bool king_side = move.to() > move.from();
+            const auto rook      = from.board[move.to().index()];
+            remove(piece, move.from());
+            remove(rook, move.to());
+            place(piece, Square::castling_king_square(king_side, us));
+            place(rook, Square::castling_rook_square(king_side, us));
+        } else if (move.typeOf() == Move::PROMOTION) {
+            remove(piece, move.from());
+            place(Piece(move.promotionType(), us), move.to());
+        } else {
+            remove(piece, move.from());
+            place(piece, move.to());
+            if (move.typeOf() == Move::ENPASSANT) remove(Piece(PieceType::PAWN, ~us), move.to().ep_square());
+        }
+
+        to.key ^= Zobrist::sideToMove();
+        to.stm = ~us;
+    }
+
     /**
      * @brief Get the occupancy bitboard for the color.
      * @param color
@@ -2533,6 +2987,24 @@ class Board {
 
     [[nodiscard]] CheckType givesCheck(const Move &m) const noexcept;
 
+    /**
+     * @brief Checks if an arbitrary move, e.g. one from a transposition table
+     * or a killer slot, is one movegen::pseudolegalmoves() could generate
+     * here: right piece, encoding, target and path, without generating moves.
+     * Safe to call with any 16-bit value, so hash collisions are harmless.
+     * @param move
+     * @return
+     */
+    [[nodiscard]] bool isPseudoLegal(const Move &move) const noexcept;
+
+    /**
+     * @brief isPseudoLegal() and legal: the move does not leave the own king
+     * in check. Costs a pin computation, not a move generation.
+     * @param move
+     * @return
+     */
+    [[nodiscard]] bool isLegal(const Move &move) const noexcept;
+
     /**
      * @brief Checks if the given color has at least 1 piece thats not pawn and not king
      * @param color
@@ -2573,6 +3045,7 @@ class Board {
     }
 
     friend std::ostream &operator<<(std::ostream &os, const Board &board);
+    friend class RepetitionHistory;
 
     /**
      * @brief Compresses the board into a PackedBoard.
@@ -2748,7 +3221,8 @@ class Board {
             board.hfm_   = 0;
             board.plies_ = 0;
 
-            board.stm_ = Color::WHITE;
+            board.stm_   = Color::WHITE;
+            board.ep_sq_ = Square::NO_SQ;
 
             board.cr_.clear();
             board.prev_states_.clear();
@@ -2823,6 +3297,7 @@ class Board {
                 board.plies_++;
             }
 
+            board.initCastlingPath();
             board.key_ = board.zobrist();
         }
 
@@ -2868,7 +3343,7 @@ class Board {
 
     virtual void removePiece(Piece piece, Square sq) { removePieceInternal(piece, sq); }
 
-    std::vector<State> prev_states_;
+    StateStack prev_states_;
 
     std::array<Bitboard, 6> pieces_bb_ = {};
     std::array<Bitboard, 2> occ_bb_    = {};
@@ -3069,7 +3544,15 @@ class Board {
 
         assert(key_ == zobrist());
 
-        // init castling_path
+        initCastlingPath();
+
+        return true;
+    }
+
+    // Squares that have to be empty for each castling move still allowed by cr_.
+    void initCastlingPath() {
+        castling_path = {};
+
         for (Color c : {Color::WHITE, Color::BLACK}) {
             const auto king_from = kingSq(c);
 
@@ -3085,8 +3568,6 @@ class Board {
                     ~(Bitboard::fromSquare(king_from) | Bitboard::fromSquare(rook_from));
             }
         }
-
-        return true;
     }
 
     template <int N>
@@ -3129,6 +3610,186 @@ class Board {
     std::string original_fen_;
 };
 
+using Position = Board::Position;
+
+static_assert(std::is_trivially_copyable<Position>::value, "Position is copied as plain memory");
+
+/**
+ * @brief A Board for search and perft: makeMove/unmakeMove place and remove
+ * pieces directly instead of through the virtual placePiece/removePiece, so
+ * the whole move can be inlined. Overrides of those hooks in a further
+ * subclass are not called, hence final. Use Board where an observer needs the
+ * hooks; a SearchBoard converts to a Board& for move generation and the rest.
+ */
+class SearchBoard final : public Board {
+   public:
+    using Board::Board;
+
+    explicit SearchBoard(const Board &board) : Board(board) {}
+
+    template <bool EXACT = false>
+    void makeMove(const Move move) {
+        makeMoveImpl<EXACT, false>(move);
+    }
+
+    void unmakeMove(const Move move) { unmakeMoveImpl<false>(move); }
+};
+
+/**
+ * @brief The keys of the positions before the current one, for repetition
+ * checks in a search. The search pushes the key of every position it makes a
+ * move from, so it also works when the Board keeps no history (copy-make).
+ * A counting filter over the low key bits answers most checks without
+ * walking the keys, and the cuckoo tables of reversible piece moves find a
+ * position one move away from a repetition (Stockfish's has_game_cycle).
+ */
+class RepetitionHistory {
+    using U64 = std::uint64_t;
+
+   public:
+    static constexpr int CAPACITY = 1024;
+
+    RepetitionHistory() { filter_.fill(0); }
+
+    /**
+     * @brief Starts from the game history of `board`, back to its last
+     * irreversible move.
+     */
+    void reset(const Board &board) noexcept {
+        while (size_ > 0) pop();
+        const int size = static_cast<int>(board.prev_states_.size());
+        const int first = std::max(0, size - static_cast<int>(board.halfMoveClock()));
+        for (int i = std::max(first, size - CAPACITY / 2); i < size; i++) push(board.prev_states_[i].hash);
+    }
+
+    void push(U64 key) noexcept {
+        assert(size_ < CAPACITY);
+        keys_[size_++] = key;
+        filter_[key & FILTER_MASK]++;
+    }
+
+    void pop() noexcept {
+        assert(size_ > 0);
+        filter_[keys_[--size_] & FILTER_MASK]--;
+    }
+
+    [[nodiscard]] int size() const noexcept { return size_; }
+
+    /**
+     * @brief Whether the position of `board` occurred before, in the last
+     * halfMoveClock() plies, with the same side to move.
+     */
+    [[nodiscard]] bool isRepetition(const Board &board) const noexcept {
+        const U64 key = board.hash();
+        const int end = std::min(static_cast<int>(board.halfMoveClock()), size_);
+        if (end < 4 || filter_[key & FILTER_MASK] == 0) return false;
+        return occursWithin(key, size_ - 2, size_ - end);
+    }
+
+    /**
+     * @brief Whether the side to move has a reversible move to a position
+     * that occurred before. `ply` is the distance from the search root: a
+     * cycle inside the search is a draw at once, one that reaches back to the
+     * game before the root only if its position already repeated.
+     */
+    [[nodiscard]] bool hasUpcomingRepetition(const Board &board, int ply) const noexcept {
+        const int end = std::min(static_cast<int>(board.halfMoveClock()), size_);
+        if (end < 3) return false;
+
+        const auto &table = cuckoo();
+        const U64 key     = board.hash();
+        const auto occ    = board.occ();
+        for (int i = 3; i <= end; i += 2) {
+            const U64 moveKey = key ^ keys_[size_ - i];
+            int j             = cuckooH1(moveKey);
+            if (table.keys[j] != moveKey) {
+                j = cuckooH2(moveKey);
+                if (table.keys[j] != moveKey) continue;
+            }
+
+            // The keys only differ by the piece moving, so the move works if
+            // nothing stands between the squares (a knight jump is never on a
+            // queen line and has nothing to check).
+            const auto move = table.moves[j];
+            const auto from = move.from(), to = move.to();
+            const bool line = attacks::queen(from, 0ULL).check(to.index());
+            if (line && !attacks::queen(from, occ).check(to.index())) continue;
+            if (ply > i) return true;
+
+            // Rc1c5 and Rc5c1 share an entry: the piece is on whichever square
+            // is occupied and has to be ours.
+            const auto piece = board.at(occ.check(from.index()) ? from : to);
+            if (piece.color() != board.sideToMove()) continue;
+            if (occursWithin(keys_[size_ - i], size_ - i - 2, size_ - end)) return true;
+        }
+
+        return false;
+    }
+
+   private:
+    static constexpr int FILTER_MASK = 4095;
+    static constexpr int CUCKOO_SIZE = 8192;
+
+    struct Cuckoo {
+        std::array<U64, CUCKOO_SIZE> keys;
+        std::array<Move, CUCKOO_SIZE> moves;
+    };
+
+    static int cuckooH1(U64 key) noexcept { return static_cast<int>(key & (CUCKOO_SIZE - 1)); }
+    static int cuckooH2(U64 key) noexcept { return static_cast<int>((key >> 16) & (CUCKOO_SIZE - 1)); }
+
+    // Every reversible move of a knight, bishop, rook, queen or king on an
+    // empty board, keyed by the hash difference it makes, 3668 of them.
+    static const Cuckoo &cuckoo() {
+        static const Cuckoo table = [] {
+            Cuckoo t;
+            t.keys.fill(0);
+            t.moves.fill(Move(Move::NO_MOVE));
+            for (const auto c : {Color::WHITE, Color::BLACK}) {
+                for (const auto pt : {PieceType::KNIGHT, PieceType::BISHOP, PieceType::ROOK, PieceType::QUEEN,
+                                      PieceType::KING}) {
+                    const auto piece = Piece(PieceType(pt), Color(c));
+                    for (int s1 = 0; s1 < 64; s1++) {
+                        const auto sq    = Square(s1);
+                        const auto reach = pt == PieceType::KNIGHT   ? attacks::knight(sq)
+                                           : pt == PieceType::KING   ? attacks::king(sq)
+                                           : pt == PieceType::BISHOP ? attacks::bishop(sq, 0ULL)
+                                           : pt == PieceType::ROOK   ? attacks::rook(sq, 0ULL)
+                                                                     : attacks::queen(sq, 0ULL);
+                        for (int s2 = s1 + 1; s2 < 64; s2++) {
+                            if (!reach.check(s2)) continue;
+                            auto move = Move::make<Move::NORMAL>(Square(s1), Square(s2));
+                            U64 key   = Zobrist::piece(piece, Square(s1)) ^ Zobrist::piece(piece, Square(s2)) ^
+                                      Zobrist::sideToMove();
+                            int i = cuckooH1(key);
+                            while (true) {
+                                std::swap(t.keys[i], key);
+                                std::swap(t.moves[i], move);
+                                if (move == Move::NO_MOVE) break;
+                                i = i == cuckooH1(key) ? cuckooH2(key) : cuckooH1(key);
+                            }
+                        }
+                    }
+                }
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    // Same-side positions from index `from` down to `last`.
+    bool occursWithin(U64 key, int from, int last) const noexcept {
+        for (int i = from; i >= std::max(last, 0); i -= 2) {
+            if (keys_[i] == key) return true;
+        }
+        return false;
+    }
+
+    std::array<U64, CAPACITY> keys_;
+    std::array<std::uint16_t, FILTER_MASK + 1> filter_;
+    int size_ = 0;
+};
+
 inline std::ostream &operator<<(std::ostream &os, const Board &b) {
     for (int i = 63; i >= 0; i -= 8) {
         for (int j = 7; j >= 0; j--) {
@@ -3283,10 +3944,16 @@ template <Color::underlying c>
 [[nodiscard]] inline Bitboard attacks::knight(Square sq) noexcept { return KnightAttacks[sq.index()]; }
 
 [[nodiscard]] inline Bitboard attacks::bishop(Square sq, Bitboard occupied) noexcept {
+#ifdef CHESS_PEXT_DISPATCH
+    if (use_pext_) return BishopTable[sq.index()].pext_attacks[BishopTable[sq.index()].pext(occupied)];
+#endif
     return BishopTable[sq.index()].attacks[BishopTable[sq.index()](occupied)];
 }
 
 [[nodiscard]] inline Bitboard attacks::rook(Square sq, Bitboard occupied) noexcept {
+#ifdef CHESS_PEXT_DISPATCH
+    if (use_pext_) return RookTable[sq.index()].pext_attacks[RookTable[sq.index()].pext(occupied)];
+#endif
     return RookTable[sq.index()].attacks[RookTable[sq.index()](occupied)];
 }
 
@@ -3320,68 +3987,87 @@ template <PieceType::underlying pt>
     if constexpr (pt == PieceType::QUEEN) return queen(sq, occupied);
 }
 
-template <bool ISROOK>
-[[nodiscard]] inline Bitboard attacks::sliderAttacks(Square sq, Bitboard occupied) noexcept {
-    static constexpr int dirs[2][4][2] = {{{1, 1}, {1, -1}, {-1, -1}, {-1, 1}}, {{1, 0}, {0, -1}, {-1, 0}, {0, 1}}};
-
-    Bitboard attacks = 0ull;
-
-    File pf = sq.file();
-    Rank pr = sq.rank();
+template <bool ROOK, int SIZE>
+inline void attacks::initSliders(Square sq, Magic &entry, [[maybe_unused]] U64 magic,
+                                 const detail::SliderAttacks<SIZE> &tables, int &offset) {
+    entry.mask = detail::sliderMask(ROOK, sq.index());
+#ifdef CHESS_USE_PEXT
+    entry.attacks = tables.pext + offset;
+#else
+    entry.magic   = magic;
+    entry.shift   = 64 - Bitboard(entry.mask).count();
+    entry.attacks = tables.magic + offset;
+#    ifdef CHESS_PEXT_DISPATCH
+    entry.pext_attacks = tables.pext + offset;
+#    endif
+#endif
+    offset += 1 << Bitboard(entry.mask).count();
+}
 
-    for (int i = 0; i < 4; ++i) {
-        int off_f = dirs[ISROOK][i][0];
-        int off_r = dirs[ISROOK][i][1];
+inline void attacks::initAttacks() {
+#ifndef CHESS_CONSTEXPR_TABLES
+    bool pext = detail::PEXT_SLIDERS;
+#    ifdef CHESS_PEXT_DISPATCH
+    pext = hasSliderBackend(SliderBackend::PEXT);
+#    endif
+    detail::fillSliderAttacks<true>(RookMagics, detail::MAGIC_SLIDERS ? RookAttacks.magic : nullptr,
+                                    pext ? RookAttacks.pext : nullptr);
+    detail::fillSliderAttacks<false>(BishopMagics, detail::MAGIC_SLIDERS ? BishopAttacks.magic : nullptr,
+                                     pext ? BishopAttacks.pext : nullptr);
+#endif
 
-        File f;
-        Rank r;
-        for (f = pf + off_f, r = pr + off_r; Square::is_valid(r, f); f += off_f, r += off_r) {
-            const auto index = Square(f, r).index();
-            attacks.set(index);
-            if (occupied.check(index)) break;
-        }
+    int rook_offset = 0, bishop_offset = 0;
+    for (int i = 0; i < 64; i++) {
+        initSliders<true>(static_cast<Square>(i), RookTable[i], RookMagics[i], RookAttacks, rook_offset);
+        initSliders<false>(static_cast<Square>(i), BishopTable[i], BishopMagics[i], BishopAttacks, bishop_offset);
     }
 
-    return attacks;
+#ifdef CHESS_PEXT_DISPATCH
+    use_pext_ = hasSliderBackend(SliderBackend::PEXT) && cpuHasFastPext();
+#endif
 }
 
-inline void attacks::initSliders(Square sq, Magic table[], U64 magic,
-                                 const std::function<Bitboard(Square, Bitboard)> &attacks) {
-    // The edges of the board are not considered for the attacks
-    // i.e. for the sq h7 edges will be a1-h1, a1-a8, a8-h8, ignoring the edge of the current square
-    const Bitboard edges = ((Bitboard(Rank::RANK_1) | Bitboard(Rank::RANK_8)) & ~Bitboard(sq.rank())) |
-                           ((Bitboard(File::FILE_A) | Bitboard(File::FILE_H)) & ~Bitboard(sq.file()));
+#ifdef CHESS_PEXT_DISPATCH
+inline bool attacks::cpuHasFastPext() noexcept {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) return false;
+    const bool amd = ebx == 0x68747541;  // "Auth"enticAMD
 
-    U64 occ = 0ULL;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    const unsigned family = ((eax >> 8) & 0xF) + ((eax >> 20) & 0xFF);
 
-    auto &table_sq = table[sq.index()];
-
-#ifndef CHESS_USE_PEXT
-    table_sq.magic = magic;
-#endif
-    table_sq.mask = (attacks(sq, occ) & ~edges).getBits();
-#ifndef CHESS_USE_PEXT
-    table_sq.shift = 64 - Bitboard(table_sq.mask).count();
+    return !amd || family >= 0x19;
+}
 #endif
 
-    if (sq < 64 - 1) {
-        table[sq.index() + 1].attacks = table_sq.attacks + (1ull << Bitboard(table_sq.mask).count());
-    }
-
-    do {
-        table_sq.attacks[table_sq(occ)] = attacks(sq, occ);
-        occ                             = (occ - table_sq.mask) & table_sq.mask;
-    } while (occ);
+inline attacks::SliderBackend attacks::sliderBackend() noexcept {
+#if defined(CHESS_USE_PEXT)
+    return SliderBackend::PEXT;
+#elif defined(CHESS_PEXT_DISPATCH)
+    return use_pext_ ? SliderBackend::PEXT : SliderBackend::MAGIC;
+#else
+    return SliderBackend::MAGIC;
+#endif
 }
 
-inline void attacks::initAttacks() {
-    BishopTable[0].attacks = BishopAttacks;
-    RookTable[0].attacks   = RookAttacks;
+inline bool attacks::hasSliderBackend(SliderBackend backend) noexcept {
+#if defined(CHESS_USE_PEXT)
+    return backend == SliderBackend::PEXT;
+#elif defined(CHESS_PEXT_DISPATCH)
+    if (backend == SliderBackend::MAGIC) return true;
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 8));  // BMI2
+#else
+    return backend == SliderBackend::MAGIC;
+#endif
+}
 
-    for (int i = 0; i < 64; i++) {
-        initSliders(static_cast<Square>(i), BishopTable, BishopMagics[i], sliderAttacks<false>);
-        initSliders(static_cast<Square>(i), RookTable, RookMagics[i], sliderAttacks<true>);
-    }
+inline bool attacks::setSliderBackend(SliderBackend backend) noexcept {
+    if (!hasSliderBackend(backend)) return false;
+#ifdef CHESS_PEXT_DISPATCH
+    use_pext_ = backend == SliderBackend::PEXT;
+#endif
+    return true;
 }
 }  // namespace chess
 
@@ -3389,28 +4075,6 @@ inline void attacks::initAttacks() {
 
 namespace chess {
 
-inline auto movegen::init_squares_between() {
-    std::array<std::array<Bitboard, 64>, 64> squares_between_bb{};
-
-    auto att = [](PieceType pt, Square sq, Bitboard occ) {
-        return (pt == PieceType::BISHOP) ? attacks::bishop(sq, occ) : attacks::rook(sq, occ);
-    };
-
-    for (int sq1 = 0; sq1 < 64; ++sq1) {
-        for (PieceType pt : {PieceType::BISHOP, PieceType::ROOK}) {
-            for (int sq2 = 0; sq2 < 64; ++sq2) {
-                if (att(pt, sq1, 0).check(sq2)) {
-                    squares_between_bb[sq1][sq2] =
-                        att(pt, sq1, Bitboard::fromSquare(sq2)) & att(pt, sq2, Bitboard::fromSquare(sq1));
-                }
-                squares_between_bb[sq1][sq2].set(sq2);
-            }
-        }
-    }
-
-    return squares_between_bb;
-}
-
 template <Color::underlying c>
 [[nodiscard]] inline std::pair<Bitboard, int> movegen::checkMask(const Board &board, Square sq) {
     const auto opp_knight = board.pieces(PieceType::KNIGHT, ~c);
@@ -3788,7 +4452,7 @@ inline void movegen::legalmoves(Movelist &movelist, const Board &board, int piec
     Bitboard movable_square;
 
     // Slider, Knights and King moves can only go to enemy or empty squares.
-    if constexpr (mt == MoveGenType::ALL)
+    if constexpr (mt == MoveGenType::ALL || mt == MoveGenType::EVASIONS)
         movable_square = opp_empty;
     else if constexpr (mt == MoveGenType::CAPTURE)
         movable_square = occ_opp;
@@ -3801,7 +4465,7 @@ inline void movegen::legalmoves(Movelist &movelist, const Board &board, int piec
         whileBitboardAdd(movelist, Bitboard::fromSquare(king_sq),
                          [&](Square sq) { return generateKingMoves(sq, seen, movable_square); });
 
-        if (mt != MoveGenType::CAPTURE && checks == 0) {
+        if (mt != MoveGenType::CAPTURE && mt != MoveGenType::EVASIONS && checks == 0) {
             Bitboard moves_bb = generateCastleMoves<c>(board, king_sq, seen, pin_hv);
 
             while (moves_bb) {
@@ -3864,6 +4528,223 @@ inline void movegen::legalmoves(Movelist &movelist, const Board &board, int piec
         legalmoves<Color::BLACK, mt>(movelist, board, pieces);
 }
 
+template <Color::underlying c, movegen::MoveGenType mt>
+inline void movegen::pseudolegalmoves(Movelist &movelist, const Board &board, int pieces) {
+    const auto king_sq = board.kingSq(c);
+
+    const Bitboard occ_us  = board.us(c);
+    const Bitboard occ_opp = board.us(~c);
+    const Bitboard occ_all = occ_us | occ_opp;
+
+    Bitboard movable_square;
+
+    if constexpr (mt == MoveGenType::ALL || mt == MoveGenType::EVASIONS)
+        movable_square = ~occ_us;
+    else if constexpr (mt == MoveGenType::CAPTURE)
+        movable_square = occ_opp;
+    else  // QUIET moves
+        movable_square = ~occ_all;
+
+    // The same generators as legalmoves without pins, checks or attacked
+    // squares, which keeps the order of legalmoves.
+    if (pieces & PieceGenType::KING) {
+        whileBitboardAdd(movelist, Bitboard::fromSquare(king_sq),
+                         [&](Square sq) { return attacks::king(sq) & movable_square; });
+
+        if (mt != MoveGenType::CAPTURE && mt != MoveGenType::EVASIONS) {
+            Bitboard moves_bb = generateCastleMoves<c>(board, king_sq, 0ull, 0ull);
+
+            while (moves_bb) {
+                Square to = moves_bb.pop();
+                movelist.add(Move::make<Move::CASTLING>(king_sq, to));
+            }
+        }
+    }
+
+    // Evasions: in double check only the king moves, in single check the
+    // others capture the checker or block on the squares in between.
+    Bitboard checkmask = constants::DEFAULT_CHECKMASK;
+
+    if constexpr (mt == MoveGenType::EVASIONS) {
+        const auto checkers = attacks::attackers(board, ~c, king_sq);
+
+        if (checkers.count() > 1) return;
+        if (checkers) checkmask = between(king_sq, checkers.lsb());
+
+        movable_square &= checkmask;
+    }
+
+    if (pieces & PieceGenType::PAWN) {
+        generatePawnMoves<c, mt>(board, movelist, 0ull, 0ull, checkmask, occ_opp);
+    }
+
+    if (pieces & PieceGenType::KNIGHT) {
+        whileBitboardAdd(movelist, board.pieces(PieceType::KNIGHT, c),
+                         [&](Square sq) { return attacks::knight(sq) & movable_square; });
+    }
+
+    if (pieces & PieceGenType::BISHOP) {
+        whileBitboardAdd(movelist, board.pieces(PieceType::BISHOP, c),
+                         [&](Square sq) { return attacks::bishop(sq, occ_all) & movable_square; });
+    }
+
+    if (pieces & PieceGenType::ROOK) {
+        whileBitboardAdd(movelist, board.pieces(PieceType::ROOK, c),
+                         [&](Square sq) { return attacks::rook(sq, occ_all) & movable_square; });
+    }
+
+    if (pieces & PieceGenType::QUEEN) {
+        whileBitboardAdd(movelist, board.pieces(PieceType::QUEEN, c),
+                         [&](Square sq) { return attacks::queen(sq, occ_all) & movable_square; });
+    }
+}
+
+template <movegen::MoveGenType mt>
+inline void movegen::pseudolegalmoves(Movelist &movelist, const Board &board, int pieces) {
+    movelist.clear();
+
+    if (board.sideToMove() == Color::WHITE)
+        pseudolegalmoves<Color::WHITE, mt>(movelist, board, pieces);
+    else
+        pseudolegalmoves<Color::BLACK, mt>(movelist, board, pieces);
+}
+
+inline bool movegen::isAttacked(const Board &board, Color color, Square sq, Bitboard occ) noexcept {
+    const auto them   = board.us(color) & occ;
+    const auto queens = board.pieces(PieceType::QUEEN) & them;
+
+    return (attacks::pawn(~color, sq) & board.pieces(PieceType::PAWN) & them) ||
+           (attacks::knight(sq) & board.pieces(PieceType::KNIGHT) & them) ||
+           (attacks::bishop(sq, occ) & ((board.pieces(PieceType::BISHOP) & them) | queens)) ||
+           (attacks::rook(sq, occ) & ((board.pieces(PieceType::ROOK) & them) | queens)) ||
+           (attacks::king(sq) & board.pieces(PieceType::KING) & them);
+}
+
+inline movegen::LegalityInfo movegen::legalityInfo(const Board &board) noexcept {
+    const auto c       = board.sideToMove();
+    const auto king_sq = board.kingSq(c);
+    const auto occ_opp = board.us(~c);
+
+    LegalityInfo info{king_sq, attacks::attackers(board, ~c, king_sq), 0ull};
+
+    // Enemy sliders that see the king when only their own side is on the
+    // board pin one of our pieces if it is the only piece in between.
+    auto snipers = (attacks::rook(king_sq, occ_opp) & board.pieces(PieceType::ROOK, PieceType::QUEEN) & occ_opp) |
+                   (attacks::bishop(king_sq, occ_opp) & board.pieces(PieceType::BISHOP, PieceType::QUEEN) & occ_opp);
+
+    while (snipers) {
+        const auto sniper   = snipers.pop();
+        const auto blockers = between(king_sq, sniper) & board.occ() & ~Bitboard::fromSquare(sniper);
+        if (blockers.count() == 1) info.pinned |= blockers & board.us(c);
+    }
+
+    return info;
+}
+
+inline bool movegen::isLegal(const Board &board, const LegalityInfo &info, Move move) noexcept {
+    const auto c    = board.sideToMove();
+    const auto from = move.from();
+    const auto to   = move.to();
+    const auto occ  = board.occ();
+
+    if (move.typeOf() == Move::CASTLING) {
+        if (info.checkers) return false;
+
+        // As legalmoves: no square the king crosses or lands on is attacked,
+        // and in Chess960 the rook is not pinned along the back rank.
+        const auto king_to = Square::castling_king_square(to > from, c);
+        auto path          = between(from, king_to);
+        while (path) {
+            if (isAttacked(board, ~c, path.pop(), occ ^ Bitboard::fromSquare(from))) return false;
+        }
+
+        return !(board.chess960() && (info.pinned & Bitboard::fromSquare(to)));
+    }
+
+    if (from == info.king) return !isAttacked(board, ~c, to, occ ^ Bitboard::fromSquare(from));
+
+    if (move.typeOf() == Move::ENPASSANT) {
+        // Two pawns leave the king's rank or diagonals at once, so look again.
+        const auto captured = to.ep_square();
+        const auto after =
+            (occ ^ Bitboard::fromSquare(from) ^ Bitboard::fromSquare(captured)) | Bitboard::fromSquare(to);
+        return !isAttacked(board, ~c, info.king, after);
+    }
+
+    // In check a move has to capture the checker or block it, and in double
+    // check only the king can move.
+    if (info.checkers) {
+        if (info.checkers.count() > 1) return false;
+        if (!(between(info.king, info.checkers.lsb()) & Bitboard::fromSquare(to))) return false;
+    }
+
+    // A pinned piece stays on the line through the king and its pinner.
+    if (info.pinned & Bitboard::fromSquare(from)) {
+        return (between(info.king, to) & Bitboard::fromSquare(from)) ||
+               (between(info.king, from) & Bitboard::fromSquare(to));
+    }
+
+    return true;
+}
+
+inline bool Board::isPseudoLegal(const Move &move) const noexcept {
+    const auto from = move.from();
+    const auto to   = move.to();
+
+    // Also rules out NO_MOVE and NULL_MOVE.
+    if (from == to) return false;
+
+    const auto piece = at(from);
+    if (piece == Piece::NONE || piece.color() != stm_) return false;
+
+    const auto type  = move.typeOf();
+    const auto to_bb = Bitboard::fromSquare(to);
+
+    // The king takes its own rook.
+    if (type == Move::CASTLING) {
+        if (piece.type() != PieceType::KING || move != Move::make<Move::CASTLING>(from, to)) return false;
+        const auto castles = stm_ == Color::WHITE ? movegen::generateCastleMoves<Color::WHITE>(*this, from, 0ull, 0ull)
+                                                  : movegen::generateCastleMoves<Color::BLACK>(*this, from, 0ull, 0ull);
+        return bool(castles & to_bb);
+    }
+
+    if (us(stm_) & to_bb) return false;
+
+    if (piece.type() == PieceType::PAWN) {
+        const auto captures = attacks::pawn(stm_, from);
+
+        if (type == Move::ENPASSANT)
+            return to == ep_sq_ && (captures & to_bb) && move == Move::make<Move::ENPASSANT>(from, to);
+
+        // Promotion bits are only set on promotions, which are all the moves
+        // to the last rank.
+        const bool promotion = to.rank() == Rank::rank(Rank::RANK_8, stm_);
+        if (promotion != (type == Move::PROMOTION)) return false;
+        if (!promotion && move != Move::make<Move::NORMAL>(from, to)) return false;
+
+        if (captures & to_bb) return bool(us(~stm_) & to_bb);
+
+        const auto up = from + make_direction(Direction::NORTH, stm_);
+        if (to == up) return !(occ() & to_bb);
+
+        return from.rank() == Rank::rank(Rank::RANK_2, stm_) && to == up + make_direction(Direction::NORTH, stm_) &&
+               !(occ() & (Bitboard::fromSquare(up) | to_bb));
+    }
+
+    if (type != Move::NORMAL || move != Move::make<Move::NORMAL>(from, to)) return false;
+
+    const auto pt = piece.type();
+    if (pt == PieceType::KNIGHT) return bool(attacks::knight(from) & to_bb);
+    if (pt == PieceType::BISHOP) return bool(attacks::bishop(from, occ()) & to_bb);
+    if (pt == PieceType::ROOK) return bool(attacks::rook(from, occ()) & to_bb);
+    if (pt == PieceType::QUEEN) return bool(attacks::queen(from, occ()) & to_bb);
+    return bool(attacks::king(from) & to_bb);
+}
+
+inline bool Board::isLegal(const Move &move) const noexcept {
+    return isPseudoLegal(move) && movegen::isLegal(*this, movegen::legalityInfo(*this), move);
+}
+
 template <Color::underlying c>
 inline bool movegen::isEpSquareValid(const Board &board, Square ep) {
     const auto stm = board.sideToMove();
@@ -3895,9 +4776,550 @@ inline bool movegen::isEpSquareValid(const Board &board, Square ep) {
     return SQUARES_BETWEEN_BB[sq1.index()][sq2.index()];
 }
 
-inline const std::array<std::array<Bitboard, 64>, 64> movegen::SQUARES_BETWEEN_BB = [] {
+namespace detail {
+
+// The PositionBatch kernel. V holds one bitboard per position: a plain
+// uint64_t for the scalar kernel, a GCC vector of 4 or 8 of them for AVX2 and
+// AVX-512. The helpers pass V by reference and are always inlined, so the
+// vector code is generated for the instruction set of the kernel they end up
+// in and no vector crosses a call.
+#ifdef CHESS_BATCH_SIMD
+#    define CHESS_BATCH_INLINE __attribute__((always_inline)) inline
+typedef std::uint64_t BatchLanes4 __attribute__((vector_size(32)));
+typedef std::uint64_t BatchLanes8 __attribute__((vector_size(64)));
+#else
+#    define CHESS_BATCH_INLINE inline
+#endif
+
+// The kernel's inputs, from the side to move's point of view: its pieces, the
+// opponent's, and per castling side the squares that must be empty and the
+// ones that must not be attacked.
+enum BatchInput {
+    BATCH_PAWNS,
+    BATCH_KNIGHTS,
+    BATCH_BISHOPS,
+    BATCH_ROOKS,
+    BATCH_QUEENS,
+    BATCH_KING,
+    BATCH_THEIR_PAWNS,
+    BATCH_THEIR_KNIGHTS,
+    BATCH_THEIR_BISHOPS,
+    BATCH_THEIR_ROOKS,
+    BATCH_THEIR_QUEENS,
+    BATCH_THEIR_KING,
+    BATCH_CASTLE_PATH,
+    BATCH_CASTLE_SAFE,
+    BATCH_CASTLE_PATH_2,
+    BATCH_CASTLE_SAFE_2,
+    BATCH_INPUTS
+};
+
+// The kernel's status word: the move count, valid unless in check.
+constexpr std::uint64_t BATCH_CHECK_FLAG = 1ull << 16;
+
+constexpr std::uint64_t BATCH_NOT_A  = 0xfefefefefefefefeull;
+constexpr std::uint64_t BATCH_NOT_AB = 0xfcfcfcfcfcfcfcfcull;
+constexpr std::uint64_t BATCH_NOT_H  = 0x7f7f7f7f7f7f7f7full;
+constexpr std::uint64_t BATCH_NOT_GH = 0x3f3f3f3f3f3f3f3full;
+constexpr std::uint64_t BATCH_RANK_3 = 0x0000000000ff0000ull;
+constexpr std::uint64_t BATCH_RANK_8 = 0xff00000000000000ull;
+
+// Mirrors a bitboard top to bottom, so black moves up the board.
+[[nodiscard]] constexpr std::uint64_t batchFlip(std::uint64_t b) noexcept {
+    b = ((b >> 8) & 0x00ff00ff00ff00ffull) | ((b & 0x00ff00ff00ff00ffull) << 8);
+    b = ((b >> 16) & 0x0000ffff0000ffffull) | ((b & 0x0000ffff0000ffffull) << 16);
+    return (b >> 32) | (b << 32);
+}
+
+// Directions are square index steps: 8 north, 1 east, 9 north-east and so on.
+template <int DIR>
+[[nodiscard]] constexpr std::uint64_t batchWrapMask() noexcept {
+    if constexpr (DIR == 1 || DIR == 9 || DIR == -7) return BATCH_NOT_A;
+    if constexpr (DIR == -1 || DIR == 7 || DIR == -9) return BATCH_NOT_H;
+    return ~0ull;
+}
+
+template <int DIR, int STEPS, typename V>
+CHESS_BATCH_INLINE void batchShift(V &out, const V &b) {
+    if constexpr (DIR > 0)
+        out = b << (DIR * STEPS);
+    else
+        out = b >> (-DIR * STEPS);
+}
+
+// The squares the sliders in gen attack in direction DIR: a Kogge-Stone fill
+// through the empty squares, then one more step onto the first blocker.
+template <int DIR, typename V>
+CHESS_BATCH_INLINE void batchRay(V &out, const V &gen, const V &empty) {
+    constexpr auto wrap = batchWrapMask<DIR>();
+
+    V g = gen, p = empty & wrap, t;
+    batchShift<DIR, 1>(t, g);
+    g |= p & t;
+    batchShift<DIR, 1>(t, p);
+    p &= t;
+    batchShift<DIR, 2>(t, g);
+    g |= p & t;
+    batchShift<DIR, 2>(t, p);
+    p &= t;
+    batchShift<DIR, 4>(t, g);
+    g |= p & t;
+    batchShift<DIR, 1>(t, g);
+    out = t & wrap;
+}
+
+// count += popcount(b) in every lane.
+template <typename V>
+CHESS_BATCH_INLINE void batchCount(V &count, const V &b) {
+    V x = b - ((b >> 1) & 0x5555555555555555ull);
+    x   = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x   = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    x += x >> 8;
+    x += x >> 16;
+    x += x >> 32;
+    count += x & 0x7f;
+}
+
+// 1 in the lanes where b is not empty, 0 elsewhere.
+template <typename V>
+CHESS_BATCH_INLINE void batchAny(V &out, const V &b) {
+    out = (b | (V{} - b)) >> 63;
+}
+
+// The eight jumps of the knights in n, one bitboard each. Every jump moves
+// each knight to a different square, so counting the targets of each one
+// counts moves.
+template <typename V>
+CHESS_BATCH_INLINE void batchKnightJumps(V (&out)[8], const V &n) {
+    out[0] = (n << 17) & BATCH_NOT_A;
+    out[1] = (n << 15) & BATCH_NOT_H;
+    out[2] = (n << 10) & BATCH_NOT_AB;
+    out[3] = (n << 6) & BATCH_NOT_GH;
+    out[4] = (n >> 15) & BATCH_NOT_A;
+    out[5] = (n >> 17) & BATCH_NOT_H;
+    out[6] = (n >> 6) & BATCH_NOT_AB;
+    out[7] = (n >> 10) & BATCH_NOT_GH;
+}
+
+template <typename V>
+CHESS_BATCH_INLINE void batchKingAttacks(V &out, const V &k) {
+    const V row = k | ((k << 1) & BATCH_NOT_A) | ((k >> 1) & BATCH_NOT_H);
+    out         = (row | (row << 8) | (row >> 8)) ^ k;
+}
+
+// Our pieces pinned along one direction from our king: the first of ours
+// seen from the king, with one of their sliders behind it. A pinned piece
+// moves along its pin only; the moves of pinned sliders and the captures of
+// pinned pawns are counted here, and the caller counts the other pieces.
+template <int DIR, typename V>
+CHESS_BATCH_INLINE void batchPins(const V (&in)[BATCH_INPUTS], const V &empty, const V &occ_us, const V &occ_them,
+                                  V &pinned, V &pinned_file, V &count) {
+    constexpr bool diagonal = DIR == 9 || DIR == 7 || DIR == -7 || DIR == -9;
+
+    const V our_sliders   = in[diagonal ? BATCH_BISHOPS : BATCH_ROOKS] | in[BATCH_QUEENS];
+    const V their_sliders = in[diagonal ? BATCH_THEIR_BISHOPS : BATCH_THEIR_ROOKS] | in[BATCH_THEIR_QUEENS];
+
+    V from_king, behind, any;
+    batchRay<DIR>(from_king, in[BATCH_KING], empty);
+    const V blocker = from_king & occ_us;
+    batchRay<DIR>(behind, blocker, empty);
+    batchAny(any, behind & their_sliders);
+
+    const V pin = blocker & (V{} - any);
+    pinned |= pin;
+    if constexpr (DIR == 8 || DIR == -8) pinned_file |= pin;
+
+    // A slider of the pin's kind goes anywhere between our king and the
+    // pinner, or takes it.
+    batchAny(any, pin & our_sliders);
+    batchCount(count, ((from_king ^ pin) | behind) & (V{} - any));
+
+    // A pawn pinned on a forward diagonal can take a pinner next to it.
+    if constexpr (DIR == 9 || DIR == 7) {
+        const V pawn = pin & in[BATCH_PAWNS];
+        const V take = (DIR == 9 ? (pawn << 9) & BATCH_NOT_A : (pawn << 7) & BATCH_NOT_H) & occ_them;
+        V promotions{};
+        batchCount(count, take);
+        batchCount(promotions, take & BATCH_RANK_8);
+        count += (promotions << 1) + promotions;
+    }
+}
+
+// One slider direction: the attacks of both sides and the moves of our
+// sliders that are not pinned. Rays of our sliders in one direction never
+// overlap, as each stops at the next piece.
+template <int DIR, typename V>
+CHESS_BATCH_INLINE void batchSliders(const V (&in)[BATCH_INPUTS], const V &empty, const V &occ_us, const V &pinned,
+                                     V &ours, V &theirs, V &count) {
+    constexpr bool diagonal = DIR == 9 || DIR == 7 || DIR == -7 || DIR == -9;
+
+    const V our_sliders   = in[diagonal ? BATCH_BISHOPS : BATCH_ROOKS] | in[BATCH_QUEENS];
+    const V their_sliders = in[diagonal ? BATCH_THEIR_BISHOPS : BATCH_THEIR_ROOKS] | in[BATCH_THEIR_QUEENS];
+
+    V ray;
+    batchRay<DIR>(ray, our_sliders, empty);
+    ours |= ray;
+    batchRay<DIR>(ray, V(our_sliders & ~pinned), empty);
+    batchCount(count, ray & ~occ_us);
+    batchRay<DIR>(ray, their_sliders, empty);
+    theirs |= ray;
+}
+
+// Analyzes positions [0, size) of the input arrays, N at a time; the arrays
+// are padded to a multiple of N. Writes each side's attacks and the status
+// word: the number of legal moves, unless the check flag is set.
+template <typename V, int N>
+CHESS_BATCH_INLINE void batchAnalyze(const std::uint64_t *const *inputs, std::uint64_t *our_attacks,
+                                     std::uint64_t *their_attacks, std::uint64_t *status, std::size_t size) {
+    static_assert(sizeof(V) == N * sizeof(std::uint64_t));
+
+    for (std::size_t i = 0; i < size; i += N) {
+        V in[BATCH_INPUTS];
+        for (int k = 0; k < BATCH_INPUTS; k++) std::memcpy(&in[k], inputs[k] + i, sizeof(V));
+
+        const V occ_us = in[BATCH_PAWNS] | in[BATCH_KNIGHTS] | in[BATCH_BISHOPS] | in[BATCH_ROOKS] |
+                         in[BATCH_QUEENS] | in[BATCH_KING];
+        const V occ_them = in[BATCH_THEIR_PAWNS] | in[BATCH_THEIR_KNIGHTS] | in[BATCH_THEIR_BISHOPS] |
+                           in[BATCH_THEIR_ROOKS] | in[BATCH_THEIR_QUEENS] | in[BATCH_THEIR_KING];
+        const V empty = ~(occ_us | occ_them);
+
+        V ours{}, theirs{}, pinned{}, pinned_file{}, count{}, t;
+
+        batchPins<8>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+        batchPins<-8>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+        batchPins<1>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+        batchPins<-1>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+        batchPins<9>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+        batchPins<7>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+        batchPins<-7>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+        batchPins<-9>(in, empty, occ_us, occ_them, pinned, pinned_file, count);
+
+        batchSliders<8>(in, empty, occ_us, pinned, ours, theirs, count);
+        batchSliders<-8>(in, empty, occ_us, pinned, ours, theirs, count);
+        batchSliders<1>(in, empty, occ_us, pinned, ours, theirs, count);
+        batchSliders<-1>(in, empty, occ_us, pinned, ours, theirs, count);
+        batchSliders<9>(in, empty, occ_us, pinned, ours, theirs, count);
+        batchSliders<7>(in, empty, occ_us, pinned, ours, theirs, count);
+        batchSliders<-7>(in, empty, occ_us, pinned, ours, theirs, count);
+        batchSliders<-9>(in, empty, occ_us, pinned, ours, theirs, count);
+
+        // Pawns: we move north, they move south. Pinned pawns only push
+        // along a file pin.
+        const V pawns   = in[BATCH_PAWNS];
+        const V pushers = pawns & ~(pinned & ~pinned_file);
+        const V takers  = pawns & ~pinned;
+        const V left    = (takers << 7) & BATCH_NOT_H & occ_them;
+        const V right   = (takers << 9) & BATCH_NOT_A & occ_them;
+        const V push    = (pushers << 8) & empty;
+        const V twice   = ((push & BATCH_RANK_3) << 8) & empty;
+
+        ours |= ((pawns << 7) & BATCH_NOT_H) | ((pawns << 9) & BATCH_NOT_A);
+        theirs |= ((in[BATCH_THEIR_PAWNS] >> 7) & BATCH_NOT_A) | ((in[BATCH_THEIR_PAWNS] >> 9) & BATCH_NOT_H);
+
+        batchCount(count, push);
+        batchCount(count, twice);
+        batchCount(count, left);
+        batchCount(count, right);
+
+        // Each promotion is four moves.
+        V promotions{};
+        batchCount(promotions, push & BATCH_RANK_8);
+        batchCount(promotions, left & BATCH_RANK_8);
+        batchCount(promotions, right & BATCH_RANK_8);
+        count += (promotions << 1) + promotions;
+
+        // Pinned knights cannot move.
+        V jumps[8];
+        batchKnightJumps(jumps, in[BATCH_KNIGHTS]);
+        for (const auto &jump : jumps) ours |= jump;
+        batchKnightJumps(jumps, V(in[BATCH_KNIGHTS] & ~pinned));
+        for (const auto &jump : jumps) batchCount(count, jump & ~occ_us);
+        batchKnightJumps(jumps, in[BATCH_THEIR_KNIGHTS]);
+        for (const auto &jump : jumps) theirs |= jump;
+
+        V king;
+        batchKingAttacks(king, in[BATCH_KING]);
+        ours |= king;
+        batchKingAttacks(t, in[BATCH_THEIR_KING]);
+        theirs |= t;
+
+        // Out of check no slider looks through our king, so their attacks as
+        // they are tell where the king can go and castle.
+        batchCount(count, king & ~occ_us & ~theirs);
+
+        const V occ = occ_us | occ_them;
+        batchAny(t, (occ & in[BATCH_CASTLE_PATH]) | (theirs & in[BATCH_CASTLE_SAFE]));
+        count += 1 - t;
+        batchAny(t, (occ & in[BATCH_CASTLE_PATH_2]) | (theirs & in[BATCH_CASTLE_SAFE_2]));
+        count += 1 - t;
+
+        batchAny(t, theirs & in[BATCH_KING]);
+        count |= t << 16;
+
+        std::memcpy(our_attacks + i, &ours, sizeof(V));
+        std::memcpy(their_attacks + i, &theirs, sizeof(V));
+        std::memcpy(status + i, &count, sizeof(V));
+    }
+}
+
+inline void batchAnalyzeScalar(const std::uint64_t *const *inputs, std::uint64_t *our_attacks,
+                               std::uint64_t *their_attacks, std::uint64_t *status, std::size_t size) {
+    batchAnalyze<std::uint64_t, 1>(inputs, our_attacks, their_attacks, status, size);
+}
+
+#ifdef CHESS_BATCH_SIMD
+__attribute__((target("avx2"))) inline void batchAnalyzeAvx2(const std::uint64_t *const *inputs,
+                                                              std::uint64_t *our_attacks,
+                                                              std::uint64_t *their_attacks, std::uint64_t *status,
+                                                              std::size_t size) {
+    batchAnalyze<BatchLanes4, 4>(inputs, our_attacks, their_attacks, status, size);
+}
+
+__attribute__((target("avx512f"))) inline void batchAnalyzeAvx512(const std::uint64_t *const *inputs,
+                                                                   std::uint64_t *our_attacks,
+                                                                   std::uint64_t *their_attacks,
+                                                                   std::uint64_t *status, std::size_t size) {
+    batchAnalyze<BatchLanes8, 8>(inputs, our_attacks, their_attacks, status, size);
+}
+#endif
+
+}  // namespace detail
+
+/**
+ * @brief Many independent positions analyzed together, for batch analysis
+ * and data generation: for each one the squares each side attacks, whether
+ * the side to move is in check and its number of legal moves, the size
+ * movegen::legalmoves() would give.
+ *
+ * The positions are stored as structure of arrays, one array per piece
+ * bitboard, mirrored so that the side to move always moves up the board.
+ * That way one kernel of plain bitboard operations runs every position, four
+ * (AVX2) or eight (AVX-512) per instruction, picked at runtime. The kernel
+ * counts the moves of positions that are not in check and have no en passant
+ * square, nearly all of them, pinned pieces included. The others are counted
+ * by movegen::legalmoves() on a board rebuilt from the arrays. Chess960
+ * positions with castling rights are counted with it in add().
+ */
+class PositionBatch {
+   public:
+    enum class Kernel : std::uint8_t { SCALAR, AVX2, AVX512 };
+
+    void clear() noexcept {
+        for (auto &input : inputs_) input.clear();
+        castling_.clear();
+        enpassant_.clear();
+        flags_.clear();
+        moves_.clear();
+        size_ = 0;
+    }
+
+    void add(const Board &board);
+
+    [[nodiscard]] std::size_t size() const noexcept { return size_; }
+
+    /**
+     * @brief Computes the results below for every position added.
+     */
+    void analyze(Kernel kernel = bestKernel());
+
+    [[nodiscard]] Bitboard attacks(std::size_t i, Color color) const noexcept {
+        const bool black = flags_[i] & BLACK_TO_MOVE;
+        const auto bb    = (color == Color::BLACK) == black ? our_attacks_[i] : their_attacks_[i];
+        return black ? detail::batchFlip(bb) : bb;
+    }
+
+    [[nodiscard]] bool inCheck(std::size_t i) const noexcept { return flags_[i] & IN_CHECK; }
+
+    [[nodiscard]] int moveCount(std::size_t i) const noexcept { return moves_[i]; }
+
+    /**
+     * @brief Whether the kernel counted the moves of position i, rather than
+     * movegen::legalmoves().
+     */
+    [[nodiscard]] bool vectorized(std::size_t i) const noexcept { return !(flags_[i] & (MOVEGEN | PRECOUNTED)); }
+
+    /**
+     * @brief Whether this build and CPU can run a kernel. SCALAR always can;
+     * AVX2 and AVX-512 need an x86-64 GCC or Clang build without
+     * CHESS_NO_BATCH_SIMD and a CPU with AVX2 or AVX-512F.
+     */
+    [[nodiscard]] static bool hasKernel(Kernel kernel) noexcept;
+
+    [[nodiscard]] static Kernel bestKernel() noexcept {
+        if (hasKernel(Kernel::AVX512)) return Kernel::AVX512;
+        if (hasKernel(Kernel::AVX2)) return Kernel::AVX2;
+        return Kernel::SCALAR;
+    }
+
+    [[nodiscard]] static const char *kernelName(Kernel kernel) noexcept {
+        switch (kernel) {
+            case Kernel::AVX2:
+                return "avx2";
+            case Kernel::AVX512:
+                return "avx512";
+            default:
+                return "scalar";
+        }
+    }
+
+   private:
+    // Arrays are padded to a multiple of the widest kernel.
+    static constexpr std::size_t LANES = 8;
+
+    enum : std::uint8_t { BLACK_TO_MOVE = 1, EN_PASSANT = 2, PRECOUNTED = 4, IN_CHECK = 8, MOVEGEN = 16 };
+
+    [[nodiscard]] int countWithMovegen(Board &board, std::size_t i) const;
+
+    std::vector<std::uint64_t> inputs_[detail::BATCH_INPUTS];
+    std::vector<Board::CastlingRights> castling_;
+    std::vector<Square> enpassant_;
+    std::vector<std::uint8_t> flags_;
+    std::vector<std::uint16_t> moves_;
+
+    std::vector<std::uint64_t> our_attacks_, their_attacks_, status_;
+    std::size_t size_ = 0;
+};
+
+inline void PositionBatch::add(const Board &board) {
+    if (size_ % LANES == 0) {
+        for (auto &input : inputs_) input.resize(size_ + LANES);
+    }
+
+    const auto stm   = board.sideToMove();
+    const bool black = stm == Color::BLACK;
+    const auto rel   = [black](Bitboard bb) { return black ? detail::batchFlip(bb.getBits()) : bb.getBits(); };
+
+    for (int pt = 0; pt < 6; pt++) {
+        const auto type                              = PieceType(static_cast<PieceType::underlying>(pt));
+        inputs_[detail::BATCH_PAWNS + pt][size_]       = rel(board.pieces(type, stm));
+        inputs_[detail::BATCH_THEIR_PAWNS + pt][size_] = rel(board.pieces(type, ~stm));
+    }
+
+    // Without the right the path is every square, which is never empty.
+    const auto king = board.kingSq(stm);
+    for (int k = 0; k < 2; k++) {
+        const bool king_side = k == 0;
+        const auto side = king_side ? Board::CastlingRights::Side::KING_SIDE : Board::CastlingRights::Side::QUEEN_SIDE;
+        Bitboard path = ~0ull, safe = 0ull;
+
+        if (board.castlingRights().has(stm, side)) {
+            path               = board.getCastlingPath(stm, king_side);
+            const auto king_to = Square::castling_king_square(king_side, stm);
+            for (int sq = king.index(); sq != king_to.index();) {
+                sq += king_to.index() > king.index() ? 1 : -1;
+                safe |= Bitboard::fromSquare(sq);
+            }
+        }
+
+        inputs_[detail::BATCH_CASTLE_PATH + 2 * k][size_] = rel(path);
+        inputs_[detail::BATCH_CASTLE_SAFE + 2 * k][size_] = rel(safe);
+    }
+
+    std::uint8_t flags = black ? BLACK_TO_MOVE : 0;
+    if (board.enpassantSq() != Square::NO_SQ) flags |= EN_PASSANT;
+
+    // The kernel knows standard castling only.
+    std::uint16_t moves = 0;
+    if (board.chess960() && board.castlingRights().has(stm)) {
+        Movelist ml;
+        movegen::legalmoves(ml, board);
+        moves = ml.size();
+        flags |= PRECOUNTED;
+    }
+
+    castling_.push_back(board.castlingRights());
+    enpassant_.push_back(board.enpassantSq());
+    flags_.push_back(flags);
+    moves_.push_back(moves);
+    size_++;
+}
+
+inline void PositionBatch::analyze(Kernel kernel) {
+    const std::size_t padded = inputs_[0].size();
+    our_attacks_.resize(padded);
+    their_attacks_.resize(padded);
+    status_.resize(padded);
+
+    const std::uint64_t *inputs[detail::BATCH_INPUTS];
+    for (int k = 0; k < detail::BATCH_INPUTS; k++) inputs[k] = inputs_[k].data();
+
+    if (!hasKernel(kernel)) kernel = Kernel::SCALAR;
+    switch (kernel) {
+#ifdef CHESS_BATCH_SIMD
+        case Kernel::AVX2:
+            detail::batchAnalyzeAvx2(inputs, our_attacks_.data(), their_attacks_.data(), status_.data(), padded);
+            break;
+        case Kernel::AVX512:
+            detail::batchAnalyzeAvx512(inputs, our_attacks_.data(), their_attacks_.data(), status_.data(), padded);
+            break;
+#endif
+        default:
+            detail::batchAnalyzeScalar(inputs, our_attacks_.data(), their_attacks_.data(), status_.data(), padded);
+    }
+
+    Board board;
+    for (std::size_t i = 0; i < size_; i++) {
+        const auto status = status_[i];
+        auto &flags       = flags_[i];
+
+        flags &= ~(IN_CHECK | MOVEGEN);
+        if (status & detail::BATCH_CHECK_FLAG) flags |= IN_CHECK;
+        if (flags & PRECOUNTED) continue;
+
+        if ((status & detail::BATCH_CHECK_FLAG) || (flags & EN_PASSANT)) {
+            flags |= MOVEGEN;
+            moves_[i] = countWithMovegen(board, i);
+        } else {
+            moves_[i] = status & 0xffff;
+        }
+    }
+}
+
+inline int PositionBatch::countWithMovegen(Board &board, std::size_t i) const {
+    const bool black = flags_[i] & BLACK_TO_MOVE;
+    const Color stm  = black ? Color::BLACK : Color::WHITE;
+
+    Board::Position pos{};
+    pos.board.fill(Piece::NONE);
+    for (int pt = 0; pt < 6; pt++) {
+        const auto type = PieceType(static_cast<PieceType::underlying>(pt));
+        for (const Color color : {stm, Color(~stm)}) {
+            auto bb = inputs_[(color == stm ? detail::BATCH_PAWNS : detail::BATCH_THEIR_PAWNS) + pt][i];
+            if (black) bb = detail::batchFlip(bb);
+
+            pos.pieces[pt] |= bb;
+            pos.occ[color] |= bb;
+            for (Bitboard squares = bb; squares;) pos.board[squares.pop()] = Piece(type, color);
+        }
+    }
+    pos.castling  = castling_[i];
+    pos.enpassant = enpassant_[i];
+    pos.stm       = stm;
+    board.setPosition(pos);
+
+    Movelist ml;
+    movegen::legalmoves(ml, board);
+    return ml.size();
+}
+
+inline bool PositionBatch::hasKernel(Kernel kernel) noexcept {
+    switch (kernel) {
+        case Kernel::SCALAR:
+            return true;
+#ifdef CHESS_BATCH_SIMD
+        case Kernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case Kernel::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+inline const bool attacks::initialized_ = [] {
     attacks::initAttacks();
-    return movegen::init_squares_between();
+    return true;
 }();
 
 }  // namespace chess
@@ -0,0 +1,165 @@
+// Specialized endgame knowledge, looked up by material signature.
+// A position's material key packs the piece counts of both sides, so a single
+// hash lookup tells us whether a dedicated evaluator exists for it. Positions
+// without one fall through to evaluateStatic, scaled down when the ending is
+// known to be drawish.
+#ifndef ENDGAME_HPP
+#define ENDGAME_HPP
+
+#include "chess.hpp"
+#include "evaluate.hpp"
+#include <string>
+#include <unordered_map>
+
+// Scores returned by the evaluators are from the strong side's point of view.
+typedef int (*EndgameFunc)(const chess::Board &board, chess::Color strong);
+
+struct EndgameEntry {
+    EndgameFunc eval;
+    chess::Color strong;
+};
+
+const int ENDGAME_WIN_BONUS = 2000;
+const int SCALE_NORMAL = 64;
+
+// Four bits per piece type and colour, kings left out.
+inline uint64_t materialKey(const chess::Board &board)
+{
+    uint64_t key = 0;
+    for (chess::Color c : {chess::Color::WHITE, chess::Color::BLACK}) {
+        int i = 0;
+        for (chess::PieceType pt : {chess::PieceType::PAWN, chess::PieceType::KNIGHT, chess::PieceType::BISHOP, chess::PieceType::ROOK, chess::PieceType::QUEEN}) {
+            key |= uint64_t(board.pieces(pt, c).count()) << (4 * (c * 5 + i++));
+        }
+    }
+    return key;
+}
+
+// Key for a signature such as "KBNK", with the strong side's pieces first.
+inline uint64_t materialKey(const std::string &code, chess::Color strong)
+{
+    static const std::string letters = "PNBRQ";
+    uint64_t key = 0;
+    int side = -1;
+    for (char ch : code) {
+        if (ch == 'K') {
+            side++;
+            continue;
+        }
+        chess::Color c = side == 0 ? strong : ~strong;
+        key += uint64_t(1) << (4 * (c * 5 + letters.find(ch)));
+    }
+    return key;
+}
+
+// Bonus for driving the king towards the edge, and towards the corners most.
+inline int pushToEdge(chess::Square sq)
+{
+    int file = sq.file(), rank = sq.rank();
+    int fileDist = std::min(file, 7 - file);
+    int rankDist = std::min(rank, 7 - rank);
+    return 90 - 10 * (fileDist * fileDist + rankDist * rankDist);
+}
+
+inline int pushClose(chess::Square a, chess::Square b)
+{
+    return 140 - 20 * chess::Square::distance(a, b);
+}
+
+inline int evaluateDraw(const chess::Board &, chess::Color)
+{
+    return 0;
+}
+
+// KQK, KRK: no technique needed beyond driving the weak king to the edge and
+// bringing our own king close.
+inline int evaluateKXK(const chess::Board &board, chess::Color strong)
+{
+    chess::Square strongKing = board.kingSq(strong);
+    chess::Square weakKing = board.kingSq(~strong);
+    int material = 0;
+    for (chess::PieceType pt : {chess::PieceType::KNIGHT, chess::PieceType::BISHOP, chess::PieceType::ROOK, chess::PieceType::QUEEN}) {
+        material += getpieceValue(pt) * board.pieces(pt, strong).count();
+    }
+    return ENDGAME_WIN_BONUS + material + pushToEdge(weakKing) + pushClose(strongKing, weakKing);
+}
+
+// KBNK: mate only happens in a corner of the bishop's colour, so drive the weak
+// king there rather than to any edge.
+inline int evaluateKBNK(const chess::Board &board, chess::Color strong)
+{
+    chess::Square strongKing = board.kingSq(strong);
+    chess::Square weakKing = board.kingSq(~strong);
+    chess::Square bishop = board.pieces(chess::PieceType::BISHOP, strong).lsb();
+
+    chess::Square cornerA = bishop.is_light() ? chess::Square("a8") : chess::Square("a1");
+    chess::Square cornerB = bishop.is_light() ? chess::Square("h1") : chess::Square("h8");
+    int cornerDist = std::min(chess::Square::distance(weakKing, cornerA), chess::Square::distance(weakKing, cornerB));
+
+    return ENDGAME_WIN_BONUS + getpieceValue(chess::PieceType::BISHOP) + getpieceValue(chess::PieceType::KNIGHT)
+           + pushToEdge(weakKing) / 2 + 40 * (7 - cornerDist) + pushClose(strongKing, weakKing);
+}
+
+inline const std::unordered_map<uint64_t, EndgameEntry> &endgameTable()
+{
+    static const std::unordered_map<uint64_t, EndgameEntry> table = [] {
+        std::unordered_map<uint64_t, EndgameEntry> t;
+        const std::pair<const char *, EndgameFunc> endgames[] = {
+            {"KQK", evaluateKXK},   {"KRK", evaluateKXK},   {"KBNK", evaluateKBNK},
+            {"KNNK", evaluateDraw}, {"KBKB", evaluateDraw}, {"KNKN", evaluateDraw},
+            {"KBKN", evaluateDraw},
+        };
+        for (auto &eg : endgames) {
+            for (chess::Color strong : {chess::Color::WHITE, chess::Color::BLACK}) {
+                t[materialKey(eg.first, strong)] = {eg.second, strong};
+            }
+        }
+        return t;
+    }();
+    return table;
+}
+
+// Returns true and a White-relative score if a specialized evaluator handles
+// this material signature.
+inline bool probeEndgame(const chess::Board &board, int &score)
+{
+    const auto &table = endgameTable();
+    auto it = table.find(materialKey(board));
+    if (it == table.end()) return false;
+
+    score = it->second.eval(board, it->second.strong);
+    if (it->second.strong == chess::Color::BLACK) score = -score;
+    return true;
+}
+
+// Scale factor out of SCALE_NORMAL for endings the generic eval overrates:
+// pure opposite-coloured bishops, and a pawnless strong side that is level in
+// pieces or at most a minor piece ahead (KRKB, KRKN, KBKN and the like). A
+// strong side with less material than the other is left alone: the eval
+// favours it for some other reason.
+inline int endgameScale(const chess::Board &board, int score)
+{
+    chess::Color strong = score >= 0 ? chess::Color::WHITE : chess::Color::BLACK;
+
+    chess::Bitboard wB = board.pieces(chess::PieceType::BISHOP, chess::Color::WHITE);
+    chess::Bitboard bB = board.pieces(chess::PieceType::BISHOP, chess::Color::BLACK);
+    chess::Bitboard others = board.pieces(chess::PieceType::KNIGHT, chess::PieceType::ROOK) | board.pieces(chess::PieceType::QUEEN);
+    if (wB.count() == 1 && bB.count() == 1 && !others
+        && !chess::Square::same_color(chess::Square(wB.lsb()), chess::Square(bB.lsb()))) {
+        return SCALE_NORMAL / 2;
+    }
+
+    if (!board.pieces(chess::PieceType::PAWN, strong)) {
+        int strongMaterial = 0, weakMaterial = 0;
+        for (chess::PieceType pt : {chess::PieceType::KNIGHT, chess::PieceType::BISHOP, chess::PieceType::ROOK, chess::PieceType::QUEEN}) {
+            strongMaterial += getpieceValue(pt) * board.pieces(pt, strong).count();
+            weakMaterial += getpieceValue(pt) * board.pieces(pt, ~strong).count();
+        }
+        if (strongMaterial >= weakMaterial && strongMaterial - weakMaterial <= getpieceValue(chess::PieceType::BISHOP)) {
+            return SCALE_NORMAL / 4;
+        }
+    }
+    return SCALE_NORMAL;
+}
+
+#endif
@@ -0,0 +1,104 @@
+// Evaluation weights for evaluate.hpp.
+// These are the hand-set defaults; tuner.cpp can regenerate this file from
+// game results.
+#ifndef EVALPARAMS_HPP
+#define EVALPARAMS_HPP
+
+enum EvalParam {
+    PAWN_VALUE,
+    KNIGHT_VALUE,
+    BISHOP_VALUE,
+    ROOK_VALUE,
+    QUEEN_VALUE,
+    CENTER_OCCUPY,
+    CENTER_PAWN,
+    PAWN_ADVANCE,
+    CENTER_PAWN_ADVANCE,
+    CENTER_PAWN_RANK4,
+    CENTER_PAWN_RANK5,
+    PASSED_PAWN_MG,
+    PASSED_PAWN_EG,
+    KING_CENTER_EG,
+    KING_SHIELD,
+    ROOK_OPEN_FILE,
+    ROOK_SEVENTH,
+    BISHOP_PAIR,
+    MOBILITY_KNIGHT,
+    MOBILITY_BISHOP,
+    MOBILITY_ROOK,
+    MOBILITY_QUEEN,
+    KING_ZONE_KNIGHT,
+    KING_ZONE_BISHOP,
+    KING_ZONE_ROOK,
+    KING_ZONE_QUEEN,
+    THREAT_BY_PAWN,
+    THREAT_BY_MINOR,
+    HANGING_PIECE,
+    NUM_EVAL_PARAMS
+};
+
+const char *const evalParamNames[NUM_EVAL_PARAMS] = {
+    "PAWN_VALUE",
+    "KNIGHT_VALUE",
+    "BISHOP_VALUE",
+    "ROOK_VALUE",
+    "QUEEN_VALUE",
+    "CENTER_OCCUPY",
+    "CENTER_PAWN",
+    "PAWN_ADVANCE",
+    "CENTER_PAWN_ADVANCE",
+    "CENTER_PAWN_RANK4",
+    "CENTER_PAWN_RANK5",
+    "PASSED_PAWN_MG",
+    "PASSED_PAWN_EG",
+    "KING_CENTER_EG",
+    "KING_SHIELD",
+    "ROOK_OPEN_FILE",
+    "ROOK_SEVENTH",
+    "BISHOP_PAIR",
+    "MOBILITY_KNIGHT",
+    "MOBILITY_BISHOP",
+    "MOBILITY_ROOK",
+    "MOBILITY_QUEEN",
+    "KING_ZONE_KNIGHT",
+    "KING_ZONE_BISHOP",
+    "KING_ZONE_ROOK",
+    "KING_ZONE_QUEEN",
+    "THREAT_BY_PAWN",
+    "THREAT_BY_MINOR",
+    "HANGING_PIECE",
+};
+
+const int evalParams[NUM_EVAL_PARAMS] = {
+    100,  // PAWN_VALUE
+    320,  // KNIGHT_VALUE
+    330,  // BISHOP_VALUE
+    500,  // ROOK_VALUE
+    900,  // QUEEN_VALUE
+    30,  // CENTER_OCCUPY
+    15,  // CENTER_PAWN
+    3,  // PAWN_ADVANCE
+    5,  // CENTER_PAWN_ADVANCE
+    10,  // CENTER_PAWN_RANK4
+    15,  // CENTER_PAWN_RANK5
+    25,  // PASSED_PAWN_MG
+    50,  // PASSED_PAWN_EG
+    10,  // KING_CENTER_EG
+    10,  // KING_SHIELD
+    25,  // ROOK_OPEN_FILE
+    20,  // ROOK_SEVENTH
+    50,  // BISHOP_PAIR
+    4,  // MOBILITY_KNIGHT
+    5,  // MOBILITY_BISHOP
+    2,  // MOBILITY_ROOK
+    1,  // MOBILITY_QUEEN
+    8,  // KING_ZONE_KNIGHT
+    6,  // KING_ZONE_BISHOP
+    8,  // KING_ZONE_ROOK
+    10,  // KING_ZONE_QUEEN
+    40,  // THREAT_BY_PAWN
+    25,  // THREAT_BY_MINOR
+    30,  // HANGING_PIECE
+};
+
+#endif
@@ -0,0 +1,317 @@
+// Static evaluation shared by aethi.cpp and tuner.cpp.
+// Every term is a weight from evalparams.hpp times a count, so passing an
+// EvalTrace records the counts and the tuner can re-score a position for any
+// weight vector without running the evaluation again.
+#ifndef EVALUATE_HPP
+#define EVALUATE_HPP
+
+#include "chess.hpp"
+#include "evalparams.hpp"
+#include <array>
+#include <cstdlib>
+#include <algorithm>
+#include <utility>
+
+struct EvalTrace {
+    int coeffs[NUM_EVAL_PARAMS] = {};
+};
+
+inline void addTerm(int &score, EvalTrace *trace, EvalParam param, int count)
+{
+    score += evalParams[param] * count;
+    if (trace) trace->coeffs[param] += count;
+}
+
+inline int getpieceValue(chess::PieceType piece)
+{
+    if (piece == chess::PieceType::PAWN) return evalParams[PAWN_VALUE];
+    if (piece == chess::PieceType::KNIGHT) return evalParams[KNIGHT_VALUE];
+    if (piece == chess::PieceType::BISHOP) return evalParams[BISHOP_VALUE];
+    if (piece == chess::PieceType::ROOK) return evalParams[ROOK_VALUE];
+    if (piece == chess::PieceType::QUEEN) return evalParams[QUEEN_VALUE];
+    if (piece == chess::PieceType::KING) return 20000;
+    return 0;
+}
+
+// The phase is counted with fixed piece values rather than the tuned ones, so
+// that tuning the piece values does not move positions between the middlegame
+// and endgame terms behind the tuner's back.
+inline bool isEndgame(const chess::Board &board) {
+    static const std::pair<chess::PieceType, int> phaseValues[] = {
+        {chess::PieceType::QUEEN, 900}, {chess::PieceType::ROOK, 500}, {chess::PieceType::BISHOP, 330}, {chess::PieceType::KNIGHT, 320}};
+    int material = 0;
+    for (const auto &[pt, value] : phaseValues) {
+        material += value * (board.pieces(pt, chess::Color::WHITE).count() + board.pieces(pt, chess::Color::BLACK).count());
+    }
+    return material < 2500;
+}
+
+// Material only, from White's point of view. This is the cheap first stage of
+// the engine's lazy evaluation.
+inline int evaluateMaterial(const chess::Board &board, EvalTrace *trace = nullptr)
+{
+    static const EvalParam valueParams[] = {PAWN_VALUE, KNIGHT_VALUE, BISHOP_VALUE, ROOK_VALUE, QUEEN_VALUE};
+
+    int score = 0;
+    int i = 0;
+    for (chess::PieceType pt : {chess::PieceType::PAWN, chess::PieceType::KNIGHT, chess::PieceType::BISHOP, chess::PieceType::ROOK, chess::PieceType::QUEEN})
+    {
+        int wCount = board.pieces(pt, chess::Color::WHITE).count();
+        int bCount = board.pieces(pt, chess::Color::BLACK).count();
+        addTerm(score, trace, valueParams[i++], wCount - bCount);
+    }
+    return score;
+}
+
+inline int evaluateKingActivity(const chess::Board &board, bool endgame, EvalTrace *trace = nullptr) {
+    int score = 0;
+
+    for (chess::Color c : {chess::Color::WHITE, chess::Color::BLACK}) {
+        chess::Bitboard king = board.pieces(chess::PieceType::KING, c);
+        if (king) {
+            chess::Square kingSq = king.pop();
+            int kingRank = kingSq.rank();
+            int kingFile = kingSq.file();
+            int sign = c == chess::Color::WHITE ? 1 : -1;
+
+            if (endgame)
+            {
+                int centerDistance = std::abs(kingFile - 3.5) + std::abs(kingRank - 3.5);
+                addTerm(score, trace, KING_CENTER_EG, sign * (7 - centerDistance));
+            }
+            else
+            {
+                int shield = 0;
+                int shieldRank = kingRank + (c == chess::Color::WHITE ? 1 : -1);
+
+                if (shieldRank >= 0 && shieldRank <= 7) {
+                    for (int a = -1; a <= 1; ++a) {
+                        int shieldFile = kingFile + a;
+                        if (shieldFile >= 0 && shieldFile <= 7) {
+                            chess::Square shieldSq = chess::Square(static_cast<chess::File>(shieldFile), static_cast<chess::Rank>(shieldRank));
+                            chess::Piece p = board.at(shieldSq);
+                            if (p.type() == chess::PieceType::PAWN && p.color() == c) {
+                                shield++;
+                            }
+                        }
+                    }
+                }
+                addTerm(score, trace, KING_SHIELD, sign * shield);
+            }
+        }
+    }
+    return score;
+}
+
+inline int evaluateRooks(const chess::Board &board, EvalTrace *trace = nullptr) {
+    int score = 0;
+
+    for (chess::Color c : {chess::Color::WHITE, chess::Color::BLACK}) {
+        chess::Bitboard rooks = board.pieces(chess::PieceType::ROOK, c);
+        int sign = c == chess::Color::WHITE ? 1 : -1;
+        while (rooks) {
+            chess::Square rookSq = rooks.pop();
+            int file = rookSq.file();
+            int rank = rookSq.rank();
+            bool openFile = true;
+            for (int r = 0; r < 8; r++) {
+                chess::Square sq = chess::Square(static_cast<chess::File>(file), static_cast<chess::Rank>(r));
+                if (board.at<chess::PieceType>(sq) == chess::PieceType::PAWN) {
+                    openFile = false;
+                    break;
+                }
+            }
+            if (openFile) {
+                addTerm(score, trace, ROOK_OPEN_FILE, sign);
+            }
+            if ((c == chess::Color::WHITE && rank == 6) || (c == chess::Color::BLACK && rank == 1)) {
+                addTerm(score, trace, ROOK_SEVENTH, sign);
+            }
+        }
+    }
+    return score;
+}
+
+inline int evaluatePawns(const chess::Board &board, bool endgame, EvalTrace *trace = nullptr)
+{
+    int score = 0;
+    EvalParam passedParam = endgame ? PASSED_PAWN_EG : PASSED_PAWN_MG;
+
+    chess::Bitboard wp = board.pieces(chess::PieceType::PAWN, chess::Color::WHITE);
+    while (wp)
+    {
+        chess::Square sq = wp.pop();
+        int rank = sq.rank();
+        int file = sq.file();
+        addTerm(score, trace, PAWN_ADVANCE, rank);
+        if (file == 3 || file == 4) {
+            addTerm(score, trace, CENTER_PAWN_ADVANCE, rank);
+            if (rank == 3) addTerm(score, trace, CENTER_PAWN_RANK4, 1);
+            if (rank == 4) addTerm(score, trace, CENTER_PAWN_RANK5, 1);
+        }
+
+        bool passed = true;
+        for (int r = rank + 1; r < 8; r++) {
+            for (int f = std::max(0, file-1); f <= std::min(7, file+1); f++) {
+                chess::Square checkSq = chess::Square(static_cast<chess::File>(f), static_cast<chess::Rank>(r));
+                if (board.at<chess::PieceType>(checkSq) == chess::PieceType::PAWN &&
+                    board.at(checkSq).color() == chess::Color::BLACK) {
+                    passed = false;
+                    break;
+                }
+            }
+            if (!passed) break;
+        }
+        if (passed && rank > 3) {
+            addTerm(score, trace, passedParam, rank - 3);
+        }
+    }
+
+    chess::Bitboard bp = board.pieces(chess::PieceType::PAWN, chess::Color::BLACK);
+    while (bp)
+    {
+        chess::Square sq = bp.pop();
+        int rank = sq.rank();
+        int file = sq.file();
+        addTerm(score, trace, PAWN_ADVANCE, -(7 - rank));
+        if (file == 3 || file == 4) {
+            addTerm(score, trace, CENTER_PAWN_ADVANCE, -(7 - rank));
+            if (rank == 4) addTerm(score, trace, CENTER_PAWN_RANK4, -1);
+            if (rank == 3) addTerm(score, trace, CENTER_PAWN_RANK5, -1);
+        }
+
+        bool passed = true;
+        for (int r = rank - 1; r >= 0; r--) {
+            for (int f = std::max(0, file-1); f <= std::min(7, file+1); f++) {
+                chess::Square checkSq = chess::Square(static_cast<chess::File>(f), static_cast<chess::Rank>(r));
+                if (board.at<chess::PieceType>(checkSq) == chess::PieceType::PAWN &&
+                    board.at(checkSq).color() == chess::Color::WHITE) {
+                    passed = false;
+                    break;
+                }
+            }
+            if (!passed) break;
+        }
+        if (passed && rank < 4) {
+            addTerm(score, trace, passedParam, -(4 - rank));
+        }
+    }
+    return score;
+}
+
+// Squares attacked by each side, filled in once by evaluatePieces and then
+// shared by the terms that need attack information.
+struct AttackInfo {
+    chess::Bitboard byType[2][6] = {};
+    chess::Bitboard all[2] = {};
+};
+
+inline chess::Bitboard pieceAttacks(chess::PieceType pt, chess::Square sq, chess::Bitboard occ)
+{
+    if (pt == chess::PieceType::KNIGHT) return chess::attacks::knight(sq);
+    if (pt == chess::PieceType::BISHOP) return chess::attacks::bishop(sq, occ);
+    if (pt == chess::PieceType::ROOK) return chess::attacks::rook(sq, occ);
+    if (pt == chess::PieceType::QUEEN) return chess::attacks::queen(sq, occ);
+    return chess::attacks::king(sq);
+}
+
+// Mobility and king-zone pressure of the knights, bishops, rooks and queens.
+// Mobility counts squares not occupied by our own pieces and not covered by
+// enemy pawns; king-zone pressure counts attacked squares next to the enemy king.
+inline int evaluatePieces(const chess::Board &board, AttackInfo &info, EvalTrace *trace = nullptr)
+{
+    static const EvalParam mobilityParams[] = {MOBILITY_KNIGHT, MOBILITY_BISHOP, MOBILITY_ROOK, MOBILITY_QUEEN};
+    static const EvalParam kingZoneParams[] = {KING_ZONE_KNIGHT, KING_ZONE_BISHOP, KING_ZONE_ROOK, KING_ZONE_QUEEN};
+
+    int score = 0;
+    chess::Bitboard occ = board.occ();
+
+    chess::Bitboard wPawns = board.pieces(chess::PieceType::PAWN, chess::Color::WHITE);
+    chess::Bitboard bPawns = board.pieces(chess::PieceType::PAWN, chess::Color::BLACK);
+    info.byType[0][0] = chess::attacks::pawnLeftAttacks<chess::Color::WHITE>(wPawns) | chess::attacks::pawnRightAttacks<chess::Color::WHITE>(wPawns);
+    info.byType[1][0] = chess::attacks::pawnLeftAttacks<chess::Color::BLACK>(bPawns) | chess::attacks::pawnRightAttacks<chess::Color::BLACK>(bPawns);
+
+    for (chess::Color c : {chess::Color::WHITE, chess::Color::BLACK}) {
+        int sign = c == chess::Color::WHITE ? 1 : -1;
+        chess::Bitboard mobilityArea = ~board.us(c) & ~info.byType[~c][0];
+        chess::Square enemyKing = board.kingSq(~c);
+        chess::Bitboard kingZone = chess::attacks::king(enemyKing) | chess::Bitboard::fromSquare(enemyKing);
+
+        int i = 0;
+        for (chess::PieceType pt : {chess::PieceType::KNIGHT, chess::PieceType::BISHOP, chess::PieceType::ROOK, chess::PieceType::QUEEN}) {
+            chess::Bitboard pieces = board.pieces(pt, c);
+            while (pieces) {
+                chess::Bitboard att = pieceAttacks(pt, pieces.pop(), occ);
+                info.byType[c][i + 1] |= att;
+                addTerm(score, trace, mobilityParams[i], sign * (att & mobilityArea).count());
+                addTerm(score, trace, kingZoneParams[i], sign * (att & kingZone).count());
+            }
+            i++;
+        }
+        info.byType[c][5] = chess::attacks::king(board.kingSq(c));
+
+        for (int pt = 0; pt < 6; pt++) info.all[c] |= info.byType[c][pt];
+    }
+    return score;
+}
+
+// Pieces attacked by pawns, rooks and queens attacked by minors, and pieces
+// that are attacked but not defended at all.
+inline int evaluateThreats(const chess::Board &board, const AttackInfo &info, EvalTrace *trace = nullptr)
+{
+    int score = 0;
+    for (chess::Color c : {chess::Color::WHITE, chess::Color::BLACK}) {
+        int sign = c == chess::Color::WHITE ? 1 : -1;
+        chess::Bitboard targets = board.us(~c) & ~board.pieces(chess::PieceType::PAWN, chess::PieceType::KING);
+        chess::Bitboard majors = board.pieces(chess::PieceType::ROOK, chess::PieceType::QUEEN) & board.us(~c);
+        chess::Bitboard minorAttacks = info.byType[c][1] | info.byType[c][2];
+
+        addTerm(score, trace, THREAT_BY_PAWN, sign * (info.byType[c][0] & targets).count());
+        addTerm(score, trace, THREAT_BY_MINOR, sign * (minorAttacks & majors).count());
+        addTerm(score, trace, HANGING_PIECE, sign * (info.all[c] & targets & ~info.all[~c]).count());
+    }
+    return score;
+}
+
+// Full static evaluation from White's point of view, without mate or stalemate
+// detection (the search handles those before calling this).
+inline int evaluateStatic(const chess::Board &board, EvalTrace *trace = nullptr)
+{
+    int score = evaluateMaterial(board, trace);
+    bool endgame = isEndgame(board);
+
+    if (!endgame) {
+        std::array<chess::Square,4> center = { chess::Square("d4"),chess::Square("d5"),chess::Square("e4"),chess::Square("e5") };
+        std::array<chess::Square,8> centerControl = { chess::Square("c3"),chess::Square("d3"),chess::Square("e3"),chess::Square("f3"),
+                                                      chess::Square("c6"),chess::Square("d6"),chess::Square("e6"),chess::Square("f6") };
+
+        for (auto sq: center) {
+            chess::Piece p = board.at(sq);
+            if (p != chess::Piece::NONE) {
+                addTerm(score, trace, CENTER_OCCUPY, p.color() == chess::Color::WHITE ? 1 : -1);
+            }
+        }
+
+        for (auto sq: centerControl) {
+            chess::Piece p = board.at(sq);
+            if (p.type() == chess::PieceType::PAWN) {
+                addTerm(score, trace, CENTER_PAWN, p.color() == chess::Color::WHITE ? 1 : -1);
+            }
+        }
+    }
+
+    score += evaluatePawns(board, endgame, trace);
+    score += evaluateKingActivity(board, endgame, trace);
+    score += evaluateRooks(board, trace);
+
+    AttackInfo info;
+    score += evaluatePieces(board, info, trace);
+    score += evaluateThreats(board, info, trace);
+
+    if (board.pieces(chess::PieceType::BISHOP, chess::Color::WHITE).count() >= 2) addTerm(score, trace, BISHOP_PAIR, 1);
+    if (board.pieces(chess::PieceType::BISHOP, chess::Color::BLACK).count() >= 2) addTerm(score, trace, BISHOP_PAIR, -1);
+
+    return score;
+}
+
+#endif
@@ -0,0 +1,111 @@
+// Move generation shortcuts for the mate solvers.
+// On the attacker's last move of a mate search only a check can mate, so the
+// other moves need not be searched at all; and a position after a check is
+// usually refuted by a single king escape, which is cheaper to find than the
+// full list of evasions.
+#ifndef MATEGEN_HPP
+#define MATEGEN_HPP
+
+#include "chess.hpp"
+
+// Squares strictly between two squares on a common line, or none.
+inline chess::Bitboard squaresBetween(chess::Square a, chess::Square b)
+{
+    chess::Bitboard aBB = chess::Bitboard::fromSquare(a), bBB = chess::Bitboard::fromSquare(b);
+    if (chess::attacks::bishop(a, 0) & bBB) return chess::attacks::bishop(a, bBB) & chess::attacks::bishop(b, aBB);
+    if (chess::attacks::rook(a, 0) & bBB) return chess::attacks::rook(a, bBB) & chess::attacks::rook(b, aBB);
+    return 0;
+}
+
+// Where each piece type of the side to move would give check from, and which
+// of its pieces stand between its own sliders and the enemy king.
+struct CheckInfo {
+    chess::Bitboard checkSquares[6];
+    chess::Bitboard blockers;
+};
+
+inline CheckInfo checkInfo(const chess::Board &board)
+{
+    chess::Color us = board.sideToMove();
+    chess::Square ksq = board.kingSq(~us);
+    chess::Bitboard occ = board.occ();
+
+    CheckInfo info;
+    info.checkSquares[int(chess::PieceType::PAWN)] = chess::attacks::pawn(~us, ksq);
+    info.checkSquares[int(chess::PieceType::KNIGHT)] = chess::attacks::knight(ksq);
+    info.checkSquares[int(chess::PieceType::BISHOP)] = chess::attacks::bishop(ksq, occ);
+    info.checkSquares[int(chess::PieceType::ROOK)] = chess::attacks::rook(ksq, occ);
+    info.checkSquares[int(chess::PieceType::QUEEN)] =
+        info.checkSquares[int(chess::PieceType::BISHOP)] | info.checkSquares[int(chess::PieceType::ROOK)];
+    info.checkSquares[int(chess::PieceType::KING)] = 0;
+
+    info.blockers = 0;
+    chess::Bitboard snipers =
+        (chess::attacks::bishop(ksq, 0) & board.pieces(chess::PieceType::BISHOP, chess::PieceType::QUEEN))
+        | (chess::attacks::rook(ksq, 0) & board.pieces(chess::PieceType::ROOK, chess::PieceType::QUEEN));
+    snipers &= board.us(us);
+    while (snipers) {
+        chess::Square sq = snipers.pop();
+        chess::Bitboard between = squaresBetween(ksq, sq) & occ;
+        if (between.count() == 1) info.blockers |= between & board.us(us);
+    }
+    return info;
+}
+
+// Direct checks come from the table; discovered checks, promotions, castling
+// and en passant are rare enough to leave to Board::givesCheck.
+inline bool givesCheck(const chess::Board &board, const CheckInfo &info, chess::Move m)
+{
+    if (m.typeOf() != chess::Move::NORMAL || (info.blockers & chess::Bitboard::fromSquare(m.from()))) {
+        return board.givesCheck(m) != chess::CheckType::NO_CHECK;
+    }
+    return bool(info.checkSquares[int(board.at<chess::PieceType>(m.from()))] & chess::Bitboard::fromSquare(m.to()));
+}
+
+// The legal moves of the side to move that give check.
+inline void checkingMoves(const chess::Board &board, chess::Movelist &ml)
+{
+    chess::Movelist all;
+    chess::movegen::legalmoves<>(all, board);
+    CheckInfo info = checkInfo(board);
+    ml.clear();
+    for (const auto &m : all) {
+        if (givesCheck(board, info, m)) ml.add(m);
+    }
+}
+
+// Whether `color` attacks `sq` with the given occupancy.
+inline bool attackedWith(const chess::Board &board, chess::Color color, chess::Square sq, chess::Bitboard occ)
+{
+    chess::Bitboard them = board.us(color) & occ;
+    chess::Bitboard queens = board.pieces(chess::PieceType::QUEEN);
+    return (chess::attacks::pawn(~color, sq) & board.pieces(chess::PieceType::PAWN) & them)
+           || (chess::attacks::knight(sq) & board.pieces(chess::PieceType::KNIGHT) & them)
+           || (chess::attacks::king(sq) & board.pieces(chess::PieceType::KING) & them)
+           || (chess::attacks::bishop(sq, occ) & (board.pieces(chess::PieceType::BISHOP) | queens) & them)
+           || (chess::attacks::rook(sq, occ) & (board.pieces(chess::PieceType::ROOK) | queens) & them);
+}
+
+// Checkmate test that returns at the first safe king square. Only when the
+// king has none and a single piece gives check are the evasions generated.
+inline bool isMate(const chess::Board &board)
+{
+    chess::Color us = board.sideToMove();
+    chess::Square ksq = board.kingSq(us);
+    chess::Bitboard checkers = chess::attacks::attackers(board, ~us, ksq);
+    if (!checkers) return false;
+
+    chess::Bitboard occ = board.occ() ^ chess::Bitboard::fromSquare(ksq);
+    chess::Bitboard escapes = chess::attacks::king(ksq) & ~board.us(us);
+    while (escapes) {
+        chess::Square sq = escapes.pop();
+        if (!attackedWith(board, ~us, sq, occ & ~chess::Bitboard::fromSquare(sq))) return false;
+    }
+    if (checkers.count() > 1) return true;
+
+    chess::Movelist ml;
+    chess::movegen::legalmoves<>(ml, board);
+    return ml.empty();
+}
+
+#endif
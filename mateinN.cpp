@@ -1,51 +1,246 @@
 #include <iostream>
 #include "chess.hpp"
+#include "matesolver.hpp"
+#include "puzzles.hpp"
 #include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <iomanip>
 using namespace std;
 using namespace chess;
 
-bool isCheckmate(Board &board) {
-    Movelist ml;
-    movegen::legalmoves<>(ml, board);
-    return ml.empty() && board.inCheck();
+// Reads "N FEN" lines until end of input, N in attacker moves, solves each with
+// a cleared table and reports the node rate over all of them.
+void bench(MateStrategy strategy) {
+    int N;
+    string fen;
+    uint64_t totalNodes = 0;
+    double totalMs = 0;
+    int solved = 0, count = 0;
+    MateSolver solver(strategy);
+    while (cin >> N && getline(cin, fen)) {
+        Board board;
+        board.setFen(fen);
+        solver.clear();
+        auto start = chrono::steady_clock::now();
+        bool found = solver.solve(board, matePlies(N)) == 1;
+        totalMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        totalNodes += solver.nodes();
+        solved += found;
+        count++;
+    }
+    cout << strategyName(strategy) << ": solved " << solved << "/" << count << ", " << totalNodes << " nodes, "
+         << totalMs << " ms, " << (uint64_t)(totalNodes / max(totalMs, 1e-3) * 1000) << " nodes/s" << endl;
 }
 
-bool mateinN(Board &board, int N, Color attacker, vector<Move> &moves) {
-    if (N == 0)
-        return isCheckmate(board) && board.sideToMove() != attacker;
-
-    Movelist ml;
-    movegen::legalmoves<>(ml, board);
-    if (ml.empty())
-        return isCheckmate(board) && board.sideToMove() != attacker;
-
-    Color side = board.sideToMove();
-    if (side == attacker) {
-        for (auto m : ml) {
-            board.makeMove(m);
-            vector<Move> nextLine;
-            bool win = mateinN(board, N - 1, attacker, nextLine);
-            board.unmakeMove(m);
-            if (win) {
-                moves.clear();
-                moves.push_back(m);
-                moves.insert(moves.end(), nextLine.begin(), nextLine.end());
-                return true;
-            }
+bool loadPuzzles(PuzzleSet &puzzles, const vector<string> &files) {
+    auto loadStart = chrono::steady_clock::now();
+    for (const auto &file : files) {
+        if (!puzzles.load(file)) {
+            cerr << "cannot read puzzles from " << file << endl;
+            return false;
         }
-        return false;
     }
-    for (auto m : ml) {
+    double loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+    cout << "loaded " << puzzles.size() << " puzzles (" << puzzles.moves.size() << " solution moves, "
+         << puzzles.unparsedMoves << " unparsable) in " << loadMs << " ms" << endl;
+    return true;
+}
+
+struct BatchResult {
+    bool found = false;
+    bool mates = false;
+    bool keyMove = false;
+    uint64_t nodes = 0;
+    double ms = 0;
+    string line;
+};
+
+// Replays the line found from the puzzle position: every move has to be legal
+// and the last one has to mate. Its first move is compared with the stored one.
+void verifyLine(Board &board, const PuzzleSet &set, size_t index, const vector<Move> &line, BatchResult &result) {
+    Move key = set.puzzles[index].solutionCount > 0 ? set.solution(index)[0] : Move::NO_MOVE;
+    result.keyMove = !line.empty() && line[0] == key;
+
+    size_t played = 0;
+    bool legal = true;
+    for (; played < line.size(); played++) {
+        Move m = line[played];
+        Movelist ml;
+        movegen::legalmoves<>(ml, board);
+        if (find(ml.begin(), ml.end(), m) == ml.end()) {
+            legal = false;
+            break;
+        }
+        result.line += (played ? " " : "") + uci::moveToUci(m);
         board.makeMove(m);
-        bool win = mateinN(board, N - 1, attacker, moves);
-        board.unmakeMove(m);
-        if (!win)
-            return false;
     }
-    return true;
+    result.mates = legal && isMate(board);
+    while (played-- > 0)
+        board.unmakeMove(line[played]);
+}
+
+// Solves every puzzle of the given files (mate_in_N.json or m8nN.txt) on a
+// pool of threads, each with its own board and solver, and prints one line
+// per puzzle and a summary. Returns nonzero if any puzzle went unsolved or had
+// a bad line.
+int batch(MateStrategy strategy, int threads, const vector<string> &files) {
+    PuzzleSet puzzles;
+    if (!loadPuzzles(puzzles, files))
+        return 1;
+
+    vector<BatchResult> results(puzzles.size());
+    atomic<size_t> next(0);
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&] {
+            Board board;
+            MateSolver solver(strategy);
+            for (size_t i = next++; i < puzzles.size(); i = next++) {
+                const Puzzle &puzzle = puzzles.puzzles[i];
+                BatchResult &result = results[i];
+                board = puzzles.board(i);
+                solver.clear();
+                auto begin = chrono::steady_clock::now();
+                result.found = solver.solve(board, matePlies(puzzle.mateIn)) == 1;
+                result.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+                result.nodes = solver.nodes();
+                if (result.found)
+                    verifyLine(board, puzzles, i, solver.line(), result);
+            }
+        });
+    }
+    for (auto &th : pool)
+        th.join();
+    double wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    int ok = 0, alt = 0, bad = 0, unsolved = 0;
+    uint64_t totalNodes = 0;
+    double searchMs = 0;
+    for (size_t i = 0; i < puzzles.size(); i++) {
+        const BatchResult &r = results[i];
+        const char *status = !r.found ? "unsolved" : !r.mates ? "bad" : r.keyMove ? "ok" : "alt";
+        ok += r.found && r.mates && r.keyMove;
+        alt += r.found && r.mates && !r.keyMove;
+        bad += r.found && !r.mates;
+        unsolved += !r.found;
+        totalNodes += r.nodes;
+        searchMs += r.ms;
+        cout << left << setw(22) << puzzles.source(i) << setw(9) << status << right << fixed << setprecision(3)
+             << setw(10) << r.ms << " ms " << setw(10) << r.nodes << " nodes  " << r.line << "\n";
+    }
+    cout << puzzles.size() << " puzzles with " << strategyName(strategy) << " on " << threads << " threads: " << ok
+         << " ok, " << alt << " alternative key move, " << bad << " bad line, " << unsolved << " unsolved" << endl;
+    cout << totalNodes << " nodes, " << setprecision(1) << searchMs << " ms searching, " << wallMs << " ms wall, "
+         << (uint64_t)(totalNodes / max(wallMs, 1e-3) * 1000) << " nodes/s, "
+         << setprecision(1) << puzzles.size() / max(wallMs, 1e-3) * 1000 << " puzzles/s" << endl;
+    return bad || unsolved ? 1 : 0;
 }
 
-int main() {
+// Runs every strategy over the same puzzles on one thread and prints, per mate
+// length, how many each solved within the node limit and how long it took.
+// A puzzle the limit cut short is counted as undecided, not as a failure.
+int compare(uint64_t maxNodes, const vector<string> &files) {
+    PuzzleSet puzzles;
+    if (!loadPuzzles(puzzles, files))
+        return 1;
+
+    struct Totals {
+        int solved = 0, refuted = 0, undecided = 0;
+        uint64_t nodes = 0;
+        double ms = 0;
+    };
+    const int strategies = sizeof(MATE_STRATEGIES) / sizeof(MATE_STRATEGIES[0]);
+    int maxMateIn = 0;
+    for (const auto &p : puzzles.puzzles)
+        maxMateIn = max(maxMateIn, (int)p.mateIn);
+    vector<vector<Totals>> totals(maxMateIn + 1, vector<Totals>(strategies));
+
+    for (int s = 0; s < strategies; s++) {
+        MateSolver solver(MATE_STRATEGIES[s], maxNodes);
+        for (size_t i = 0; i < puzzles.size(); i++) {
+            Board board = puzzles.board(i);
+            int mateIn = puzzles.puzzles[i].mateIn;
+            solver.clear();
+            auto begin = chrono::steady_clock::now();
+            int result = solver.solve(board, matePlies(mateIn));
+            Totals &t = totals[mateIn][s];
+            t.ms += chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+            t.nodes += solver.nodes();
+            t.solved += result == 1;
+            t.refuted += result == 0;
+            t.undecided += result < 0;
+        }
+    }
+
+    int disagreements = 0;
+    cout << left << setw(9) << "mate in" << setw(11) << "strategy" << right << setw(8) << "solved" << setw(10)
+         << "undecided" << setw(14) << "nodes" << setw(12) << "ms" << endl;
+    for (int mateIn = 1; mateIn <= maxMateIn; mateIn++) {
+        int fastest = -1;
+        for (int s = 0; s < strategies; s++) {
+            const Totals &t = totals[mateIn][s];
+            if (t.solved + t.refuted + t.undecided == 0)
+                continue;
+            cout << left << setw(9) << mateIn << setw(11) << strategyName(MATE_STRATEGIES[s]) << right << setw(8)
+                 << t.solved << setw(10) << t.undecided << setw(14) << t.nodes << fixed << setprecision(1)
+                 << setw(12) << t.ms << endl;
+            disagreements += t.refuted;
+            const Totals *best = fastest < 0 ? nullptr : &totals[mateIn][fastest];
+            if (t.undecided == 0 && (!best || t.ms < best->ms))
+                fastest = s;
+        }
+        if (fastest >= 0)
+            cout << "fastest at mate in " << mateIn << ": " << strategyName(MATE_STRATEGIES[fastest]) << endl;
+    }
+    if (disagreements)
+        cout << disagreements << " puzzle searches found no mate" << endl;
+    return disagreements ? 1 : 0;
+}
+
+vector<string> puzzleFiles(int argc, char **argv, int arg) {
+    vector<string> files(argv + arg, argv + argc);
+    if (files.empty())
+        files = {"Week3/mate_in_2.json", "Week3/mate_in_3.json", "Week3/mate_in_4.json"};
+    return files;
+}
+
+// Usage: echo "N FEN" | ./mateinN [minimax | alphabeta | pns [maxNodes]]
+//        ./mateinN bench [strategy] < "N FEN" lines
+//        ./mateinN batch [strategy] [threads] [mate_in_N.json | m8nN.txt...]
+//        ./mateinN compare [maxNodes] [mate_in_N.json | m8nN.txt...]
+// N is the number of attacker moves in every mode, as in the puzzle files. The
+// default strategy is alphabeta. Batch
+// mode defaults to all cores, and batch and compare to the three
+// Week3/mate_in_N.json files.
+int main(int argc, char **argv) {
+    string mode = argc > 1 ? argv[1] : "";
+    MateStrategy strategy = MateStrategy::ALPHABETA;
+    int arg = 2;
+    if ((mode == "bench" || mode == "batch") && arg < argc && parseStrategy(argv[arg], strategy))
+        arg++;
+
+    if (mode == "bench") {
+        bench(strategy);
+        return 0;
+    }
+    if (mode == "batch") {
+        int threads = max(1u, thread::hardware_concurrency());
+        if (arg < argc && isdigit((unsigned char)argv[arg][0]))
+            threads = max(1, stoi(argv[arg++]));
+        return batch(strategy, threads, puzzleFiles(argc, argv, arg));
+    }
+    if (mode == "compare") {
+        uint64_t maxNodes = 20000000;
+        if (arg < argc && isdigit((unsigned char)argv[arg][0]))
+            maxNodes = stoull(argv[arg++]);
+        return compare(maxNodes, puzzleFiles(argc, argv, arg));
+    }
+
     int N;
     string fen;
     cin >> N;
@@ -53,15 +248,28 @@ int main() {
 
     Board board;
     board.setFen(fen);
-    vector<Move> moves;
-    Color attacker = board.sideToMove();
+    if (!mode.empty() && !parseStrategy(mode, strategy)) {
+        cerr << "unknown mode " << mode << endl;
+        return 1;
+    }
+
+    uint64_t maxNodes = 0;
+    if (strategy == MateStrategy::PROOF_NUMBER)
+        maxNodes = argc > 2 ? stoull(argv[2]) : 0;
+    MateSolver solver(strategy, maxNodes);
+    auto start = chrono::steady_clock::now();
+    int result = solver.solve(board, matePlies(N));
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-    if (mateinN(board, N, attacker, moves)) {
-        cout << "Mate in " << N << " found:";
-        for (auto &m : moves)
+    if (result == 1) {
+        cout << "Mate in " << (solver.line().size() + 1) / 2 << " found:";
+        for (auto &m : solver.line())
             cout << " " << uci::moveToUci(m);
-    } else {
+    } else if (result == 0) {
         cout << "No forced mate in " << N << " found";
+    } else {
+        cout << "Node limit reached before a mate in " << N << " was decided";
     }
+    cout << " (" << solver.nodes() << " nodes, " << ms << " ms)" << endl;
     return 0;
 }
\ No newline at end of file
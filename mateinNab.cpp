@@ -1,90 +1,96 @@
 #include <iostream>
 #include "chess.hpp"
+#include "matesolver.hpp"
+#include <string>
 #include <vector>
 #include <limits>
+#include <chrono>
+#include <algorithm>
 using namespace std;
 using namespace chess;
 
-const int INF = 100000;
+// The alpha-beta front end of matesolver.hpp: N counts attacker moves.
 
-bool isCheckmate(Board &board) {
-    Movelist ml;
-    movegen::legalmoves<>(ml, board);
-    return ml.empty() && board.inCheck();
+// Iterative deepening over the number of attacker moves. The solver keeps its
+// mate table between iterations, so refutations found with N - 1 moves cut
+// the search with N and the stored moves are tried first. The first N that
+// mates is the shortest mate. Returns 0 if there is none within maxN.
+int shortestMate(MateSolver &solver, Board &board, int maxN) {
+    for (int N = 1; N <= maxN && matePlies(N) < MateSolver::MAX_PLY; N++) {
+        auto start = chrono::steady_clock::now();
+        bool found = solver.solve(board, matePlies(N)) == 1;
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "info mate in " << N << (found ? " found" : " refuted") << ", " << solver.nodes() << " nodes, "
+             << ms << " ms" << endl;
+        if (found)
+            return N;
+    }
+    return 0;
 }
 
-int mateinN(Board &board, int depth, Color attacker, vector<Move> &moves, int alpha, int beta) {
-    if (depth == 0) {
-        if (isCheckmate(board) && board.sideToMove() != attacker) {
-            return INF;
-        }
-        return -INF;
+// Reads the same N / FEN line pairs as a single solve until end of input and
+// reports the node rate over all of them.
+void bench() {
+    int N;
+    string fen;
+    uint64_t totalNodes = 0;
+    double totalMs = 0;
+    int solved = 0, count = 0;
+    MateSolver solver(MateStrategy::ALPHABETA);
+    while (cin >> N) {
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        getline(cin, fen);
+        Board board;
+        board.setFen(fen);
+        solver.clear();
+        auto start = chrono::steady_clock::now();
+        bool found = solver.solve(board, matePlies(N)) == 1;
+        totalMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        totalNodes += solver.nodes();
+        solved += found;
+        count++;
     }
+    cout << "solved " << solved << "/" << count << ", " << totalNodes << " nodes, " << totalMs << " ms, "
+         << (uint64_t)(totalNodes / max(totalMs, 1e-3) * 1000) << " nodes/s" << endl;
+}
 
-    Movelist ml;
-    movegen::legalmoves<>(ml, board);
-    if (ml.empty()) {
-        if (isCheckmate(board) && board.sideToMove() != attacker) {
-            return INF;
-        }
-        return -INF;
+// Usage: ./mateinNab [bench | shortest], with N and the FEN on separate lines.
+// In shortest mode N is the longest mate tried.
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "bench") {
+        bench();
+        return 0;
     }
 
-    Color side = board.sideToMove();
-    if (side == attacker) {
-        int best = -INF;
-        for (auto m : ml) {
-            board.makeMove(m);
-            vector<Move> nextLine;
-            int score = mateinN(board, depth - 1, attacker, nextLine, alpha, beta);
-            board.unmakeMove(m);
-            if (score >= best) {
-                best = score;
-                moves.clear();
-                moves.push_back(m);
-                moves.insert(moves.end(), nextLine.begin(), nextLine.end());
-            }
-            alpha = max(alpha, best);
-            if (beta <= alpha) break;
-        }
-        return best;
-    } else {
-        int worst = INF;
-        for (auto m : ml) {
-            board.makeMove(m);
-            vector<Move> nextLine;
-            int score = mateinN(board, depth - 1, attacker, nextLine, alpha, beta);
-            board.unmakeMove(m);
-            if (score <= worst) {
-                worst = score;
-                moves.clear();
-                moves.push_back(m);
-                moves.insert(moves.end(), nextLine.begin(), nextLine.end());
-            }
-            beta = min(beta, worst);
-            if (beta <= alpha) break;
-        }
-        return worst;
-    }
-}
-
-int main() {
     int N;
     string fen;
     cin >> N;
-    int depth = 2*N;
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
     getline(cin, fen);
 
     Board board;
     board.setFen(fen);
-    vector<Move> moves;
-    Color attacker = board.sideToMove();
-    int score = mateinN(board, depth, attacker, moves, -INF, INF);
-    if (score > 0) {
+    MateSolver solver(MateStrategy::ALPHABETA);
+
+    if (argc > 1 && string(argv[1]) == "shortest") {
+        int mateIn = shortestMate(solver, board, N);
+        if (mateIn == 0) {
+            cout << "No checkmate in " << N << " moves found" << endl;
+            return 0;
+        }
+        vector<Move> line;
+        solver.longestLine(board, mateIn, line);
+        cout << "Shortest mate: " << mateIn << " moves (" << matePlies(mateIn) << " plies):";
+        for (auto &m : line)
+            cout << " " << uci::moveToUci(m);
+        cout << endl;
+        return 0;
+    }
+
+    if (solver.solve(board, matePlies(N)) == 1) {
         cout << "Checkmate in " << N << " moves found";
-        if (!moves.empty())
-            cout << " " << uci::moveToUci(moves[0]);
+        if (!solver.line().empty())
+            cout << " " << uci::moveToUci(solver.line()[0]);
     } else {
         cout << "No checkmate in " << N << " moves found";
     }
@@ -0,0 +1,498 @@
+// Forced-mate search shared by main.cpp, mateinN.cpp and mateinNab.cpp.
+// Three strategies use the same move generation (only checks on the
+// attacker's last move, from mategen.hpp) and the same mate test at the
+// leaves, so they can be compared on the same puzzles:
+//  - MINIMAX: the plain AND/OR search, moves in generation order.
+//  - ALPHABETA: the same search with a mate table and move ordering. With only
+//    mate / no mate as outcomes every window is null and a cutoff is the first
+//    refutation found, so the gain over minimax comes from trying the likely
+//    refutation first and from not searching a position twice.
+//  - PROOF_NUMBER: best-first proof-number search over a fixed node table.
+// Depths are in plies: a mate in N is 2N - 1 plies ending with the attacker's
+// move. The attacker is the side to move at the root unless given.
+#ifndef MATESOLVER_HPP
+#define MATESOLVER_HPP
+
+#include "chess.hpp"
+#include "mategen.hpp"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+enum class MateStrategy { MINIMAX, ALPHABETA, PROOF_NUMBER };
+
+const MateStrategy MATE_STRATEGIES[] = {MateStrategy::MINIMAX, MateStrategy::ALPHABETA, MateStrategy::PROOF_NUMBER};
+
+inline const char *strategyName(MateStrategy strategy)
+{
+    switch (strategy) {
+        case MateStrategy::MINIMAX: return "minimax";
+        case MateStrategy::ALPHABETA: return "alphabeta";
+        default: return "pns";
+    }
+}
+
+inline bool parseStrategy(const std::string &name, MateStrategy &strategy)
+{
+    for (MateStrategy s : MATE_STRATEGIES) {
+        if (name == strategyName(s)) {
+            strategy = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline int matePlies(int moves) { return 2 * moves - 1; }
+
+// The moves searched at a node with `plies` left: on the attacker's last move
+// only a check can mate.
+inline void mateMoves(const chess::Board &board, chess::Color attacker, int plies, chess::Movelist &ml)
+{
+    if (board.sideToMove() == attacker && plies == 1)
+        checkingMoves(board, ml);
+    else
+        chess::movegen::legalmoves<>(ml, board);
+}
+
+// Stable insertion sort; stable_sort would allocate a buffer at every node.
+inline void sortByScore(chess::Movelist &ml)
+{
+    for (int i = 1; i < (int)ml.size(); i++) {
+        chess::Move m = ml[i];
+        int j = i - 1;
+        for (; j >= 0 && ml[j].score() < m.score(); j--) ml[j + 1] = ml[j];
+        ml[j + 1] = m;
+    }
+}
+
+// Attacker: the stored move, then checks, then captures by victim value.
+inline void orderAttackerMoves(const chess::Board &board, chess::Movelist &ml, chess::Move hashMove)
+{
+    static const int victimValue[] = {1, 3, 3, 5, 9, 0, 0};
+    CheckInfo info = checkInfo(board);
+    for (auto &m : ml) {
+        int score = 0;
+        if (givesCheck(board, info, m)) score += 2000;
+        if (board.isCapture(m)) score += 100 + 10 * victimValue[(int)board.at<chess::PieceType>(m.to())];
+        if (m.typeOf() == chess::Move::PROMOTION) score += 500;
+        if (m == hashMove) score = 10000;
+        m.setScore(score);
+    }
+    sortByScore(ml);
+}
+
+// Defender: the stored refutation first, then the replies that leave the
+// attacker the fewest legal moves, which are the likeliest to hold.
+inline void orderDefenderMoves(chess::Board &board, chess::Movelist &ml, chess::Move hashMove, int plies)
+{
+    for (auto &m : ml) {
+        int score = 0;
+        if (plies >= 3) {
+            board.makeMove(m);
+            chess::Movelist replies;
+            chess::movegen::legalmoves<>(replies, board);
+            board.unmakeMove(m);
+            score = -(int)replies.size();
+        }
+        if (m == hashMove) score = 10000;
+        m.setScore(score);
+    }
+    sortByScore(ml);
+}
+
+// Proof-number search. The tree is kept in a fixed-size node table and grown one
+// node at a time: each iteration walks from the root to the most-proving leaf
+// (smallest proof number at attacker nodes, smallest disproof number at
+// defender nodes), expands it and backs the new numbers up to the root.
+// New children are scored by mobility: a defender with few replies is close
+// to being mated, an attacker with few moves is close to failing.
+const uint32_t PN_INF = 100000000;
+const uint32_t PN_NONE = 0xFFFFFFFF;
+
+struct PnNode {
+    chess::Move move;
+    uint32_t parent;
+    uint32_t firstChild;
+    uint16_t childCount;
+    uint8_t plies;
+    uint32_t pn;
+    uint32_t dn;
+};
+
+struct PnSearch {
+    std::vector<PnNode> nodes;
+    std::vector<chess::Move> path;
+    size_t maxNodes;
+    chess::Color attacker;
+
+    explicit PnSearch(size_t limit) : maxNodes(limit) {}
+
+    bool attackerToMove(const chess::Board &board) const { return board.sideToMove() == attacker; }
+
+    // Proof and disproof numbers for a freshly created node.
+    void evaluate(chess::Board &board, PnNode &node) {
+        if (!attackerToMove(board) && node.plies == 0) {
+            bool mate = isMate(board);
+            node.pn = mate ? 0 : PN_INF;
+            node.dn = mate ? PN_INF : 0;
+            return;
+        }
+        chess::Movelist ml;
+        mateMoves(board, attacker, node.plies, ml);
+        if (attackerToMove(board)) {
+            if (ml.empty() || node.plies == 0) {
+                node.pn = PN_INF;
+                node.dn = 0;
+            } else {
+                node.pn = 1;
+                node.dn = ml.size();
+            }
+        } else {
+            if (ml.empty()) {
+                node.pn = board.inCheck() ? 0 : PN_INF;
+                node.dn = board.inCheck() ? PN_INF : 0;
+            } else {
+                node.pn = ml.size();
+                node.dn = 1;
+            }
+        }
+    }
+
+    // Returns false when the node table is full.
+    bool expand(chess::Board &board, uint32_t index) {
+        chess::Movelist ml;
+        mateMoves(board, attacker, nodes[index].plies, ml);
+        if (nodes.size() + ml.size() > maxNodes) return false;
+
+        nodes[index].firstChild = nodes.size();
+        nodes[index].childCount = ml.size();
+        uint8_t plies = nodes[index].plies - 1;
+        for (auto m : ml) {
+            PnNode child = {m, index, PN_NONE, 0, plies, 1, 1};
+            board.makeMove(m);
+            evaluate(board, child);
+            board.unmakeMove(m);
+            nodes.push_back(child);
+        }
+        return true;
+    }
+
+    void update(uint32_t index, bool orNode) {
+        PnNode &node = nodes[index];
+        uint32_t pn = orNode ? PN_INF : 0;
+        uint32_t dn = orNode ? 0 : PN_INF;
+        for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; c++) {
+            if (orNode) {
+                pn = std::min(pn, nodes[c].pn);
+                dn = std::min(PN_INF, dn + nodes[c].dn);
+            } else {
+                pn = std::min(PN_INF, pn + nodes[c].pn);
+                dn = std::min(dn, nodes[c].dn);
+            }
+        }
+        node.pn = pn;
+        node.dn = dn;
+    }
+
+    // Returns 1 if the root is proven, 0 if disproven, -1 if out of memory.
+    int solve(chess::Board &board, int plies, chess::Color att) {
+        attacker = att;
+        nodes.clear();
+        nodes.reserve(maxNodes);
+        nodes.push_back({chess::Move::NULL_MOVE, PN_NONE, PN_NONE, 0, (uint8_t)plies, 1, 1});
+        evaluate(board, nodes[0]);
+
+        path.clear();
+        while (nodes[0].pn != 0 && nodes[0].dn != 0) {
+            uint32_t index = 0;
+            while (nodes[index].firstChild != PN_NONE) {
+                bool orNode = attackerToMove(board);
+                uint32_t best = nodes[index].firstChild;
+                for (uint32_t c = best; c < nodes[index].firstChild + nodes[index].childCount; c++) {
+                    if (orNode ? nodes[c].pn < nodes[best].pn : nodes[c].dn < nodes[best].dn) best = c;
+                }
+                board.makeMove(nodes[best].move);
+                path.push_back(nodes[best].move);
+                index = best;
+            }
+
+            bool ok = expand(board, index);
+            while (true) {
+                if (ok) update(index, attackerToMove(board));
+                if (index == 0) break;
+                board.unmakeMove(path.back());
+                path.pop_back();
+                index = nodes[index].parent;
+                ok = true;
+            }
+            if (!ok) return -1;
+        }
+        return nodes[0].pn == 0 ? 1 : 0;
+    }
+
+    // Plies until mate below a proven node, assuming the defender resists longest.
+    int mateLength(uint32_t index, bool orNode) {
+        const PnNode &node = nodes[index];
+        if (node.firstChild == PN_NONE) return 0;
+        int best = orNode ? 1000 : 0;
+        for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; c++) {
+            if (nodes[c].pn != 0) continue;
+            int len = mateLength(c, !orNode) + 1;
+            best = orNode ? std::min(best, len) : std::max(best, len);
+        }
+        return best;
+    }
+
+    void principalLine(std::vector<chess::Move> &line, bool orNode) {
+        uint32_t index = 0;
+        while (nodes[index].firstChild != PN_NONE) {
+            uint32_t best = PN_NONE;
+            int bestLen = 0;
+            for (uint32_t c = nodes[index].firstChild; c < nodes[index].firstChild + nodes[index].childCount; c++) {
+                if (nodes[c].pn != 0) continue;
+                int len = mateLength(c, !orNode);
+                if (best == PN_NONE || (orNode ? len < bestLen : len > bestLen)) {
+                    best = c;
+                    bestLen = len;
+                }
+            }
+            if (best == PN_NONE) break;
+            line.push_back(nodes[best].move);
+            index = best;
+            orNode = !orNode;
+        }
+    }
+};
+
+// One solver per thread: the line, the mate table and the proof-number tree
+// are all owned by the solver. The mate table is kept between solve() calls on
+// purpose, so that iterative deepening reuses it; call clear() between
+// unrelated positions.
+class MateSolver {
+   public:
+    static const int MAX_PLY = 64;
+    static const size_t MATE_TABLE_SIZE = 1 << 20;
+    static const size_t DEFAULT_PN_NODES = 4000000;
+
+    // `maxNodes` bounds the depth-first searches in nodes visited and the
+    // proof-number search in tree size; 0 means no bound for the former and
+    // DEFAULT_PN_NODES for the latter.
+    explicit MateSolver(MateStrategy strategy = MateStrategy::ALPHABETA, uint64_t maxNodes = 0)
+        : strategy_(strategy),
+          maxNodes_(maxNodes ? maxNodes : UINT64_MAX),
+          pn_(maxNodes ? maxNodes : DEFAULT_PN_NODES) {
+        if (strategy == MateStrategy::ALPHABETA) mateTable_.resize(MATE_TABLE_SIZE);
+    }
+
+    MateStrategy strategy() const { return strategy_; }
+
+    // Returns 1 if `attacker` mates within `plies`, 0 if not, -1 if the node
+    // limit was hit first. After a mate, line() holds the moves.
+    int solve(chess::Board &board, int plies, chess::Color attacker) {
+        plies = std::min(plies, MAX_PLY - 1);
+        attacker_ = attacker;
+        nodes_ = 0;
+        aborted_ = false;
+        line_.clear();
+
+        if (strategy_ == MateStrategy::PROOF_NUMBER) {
+            int result = pn_.solve(board, plies, attacker);
+            nodes_ = pn_.nodes.size();
+            if (result == 1) pn_.principalLine(line_, board.sideToMove() == attacker);
+            return result;
+        }
+
+        bool mate = strategy_ == MateStrategy::ALPHABETA ? search<true>(board, plies, 0) : search<false>(board, plies, 0);
+        if (aborted_) return -1;
+        if (mate) line_.assign(pvTable_[0], pvTable_[0] + pvLength_[0]);
+        return mate;
+    }
+
+    int solve(chess::Board &board, int plies) { return solve(board, plies, board.sideToMove()); }
+
+    // The line from a position that is mate in exactly `moves`: the attacker
+    // plays a move that keeps the mate, the defender the reply that puts it
+    // off longest. Returns false if a search hit the node limit.
+    bool longestLine(chess::Board &board, int moves, std::vector<chess::Move> &line) {
+        chess::Color attacker = board.sideToMove();
+        std::vector<chess::Move> played;
+        bool complete = true;
+        for (int movesLeft = moves; movesLeft > 0 && complete;) {
+            chess::Movelist ml;
+            chess::movegen::legalmoves<>(ml, board);
+            chess::Move attack = chess::Move::NULL_MOVE;
+            for (auto m : ml) {
+                board.makeMove(m);
+                int result = solve(board, 2 * movesLeft - 2, attacker);
+                board.unmakeMove(m);
+                complete = result >= 0;
+                if (result != 0) {
+                    attack = m;
+                    break;
+                }
+            }
+            if (attack == chess::Move::NULL_MOVE || !complete) break;
+            board.makeMove(attack);
+            played.push_back(attack);
+            if (--movesLeft == 0) break;
+
+            chess::Move defence = chess::Move::NULL_MOVE;
+            int longest = 0;
+            chess::movegen::legalmoves<>(ml, board);
+            for (auto m : ml) {
+                board.makeMove(m);
+                int distance = 1;
+                int result;
+                while ((result = solve(board, matePlies(distance), attacker)) == 0 && distance < movesLeft)
+                    distance++;
+                board.unmakeMove(m);
+                if (result < 0) complete = false;
+                if (distance > longest) {
+                    longest = distance;
+                    defence = m;
+                }
+            }
+            board.makeMove(defence);
+            played.push_back(defence);
+            movesLeft = longest;
+        }
+        for (int i = (int)played.size() - 1; i >= 0; i--) board.unmakeMove(played[i]);
+        line = played;
+        line_ = played;
+        return complete;
+    }
+
+    const std::vector<chess::Move> &line() const { return line_; }
+
+    uint64_t nodes() const { return nodes_; }
+
+    void clear() { generation_++; }
+
+   private:
+    // Mate results per position, keyed by Board::hash(). A mate found with N
+    // plies left is still a mate with more plies, and a refutation with N plies
+    // left still refutes with fewer, so one entry answers queries at any depth.
+    // Entries are replaced on collision. Keys are salted with a generation
+    // number, so clearing the table is an increment.
+    struct MateEntry {
+        uint64_t key = 0;
+        int8_t provenDepth = 127;
+        int8_t disprovenDepth = -1;
+        chess::Move best = chess::Move::NULL_MOVE;
+    };
+
+    MateStrategy strategy_;
+    uint64_t maxNodes_;
+    chess::Color attacker_ = chess::Color::WHITE;
+    uint64_t nodes_ = 0;
+    bool aborted_ = false;
+    std::vector<chess::Move> line_;
+
+    // Triangular principal-variation array: pvTable_[ply] holds the line found
+    // below the node at that ply.
+    chess::Move pvTable_[MAX_PLY][MAX_PLY];
+    int pvLength_[MAX_PLY];
+
+    std::vector<MateEntry> mateTable_;
+    uint64_t generation_ = 0;
+
+    PnSearch pn_;
+
+    MateEntry *probeMate(uint64_t key) {
+        key ^= generation_ * 0x9E3779B97F4A7C15ULL;
+        MateEntry &entry = mateTable_[key & (MATE_TABLE_SIZE - 1)];
+        return entry.key == key ? &entry : nullptr;
+    }
+
+    void storeMate(uint64_t key, int plies, bool proven, chess::Move best) {
+        key ^= generation_ * 0x9E3779B97F4A7C15ULL;
+        MateEntry &entry = mateTable_[key & (MATE_TABLE_SIZE - 1)];
+        if (entry.key != key) {
+            entry = MateEntry();
+            entry.key = key;
+        }
+        if (proven)
+            entry.provenDepth = std::min<int>(entry.provenDepth, plies);
+        else
+            entry.disprovenDepth = std::max<int>(entry.disprovenDepth, plies);
+        if (best != chess::Move::NULL_MOVE) entry.best = best;
+    }
+
+    // Rebuilds the line below a proven position at `ply` from the stored best moves.
+    void tableLine(chess::Board &board, int plies, int ply) {
+        int length = 0;
+        while (length < plies && ply + length < MAX_PLY) {
+            MateEntry *entry = probeMate(board.hash());
+            if (!entry || entry->best == chess::Move::NULL_MOVE) break;
+            pvTable_[ply][length++] = entry->best;
+            board.makeMove(entry->best);
+        }
+        pvLength_[ply] = length;
+        for (int i = length - 1; i >= 0; i--) board.unmakeMove(pvTable_[ply][i]);
+    }
+
+    void updatePv(int ply, chess::Move m) {
+        pvTable_[ply][0] = m;
+        for (int i = 0; i < pvLength_[ply + 1]; i++) pvTable_[ply][i + 1] = pvTable_[ply + 1][i];
+        pvLength_[ply] = pvLength_[ply + 1] + 1;
+    }
+
+    // The depth-first strategies. An attacker node is won by the first move
+    // that mates, a defender node lost by the first reply that does not.
+    template <bool UseTable>
+    bool search(chess::Board &board, int plies, int ply) {
+        nodes_++;
+        pvLength_[ply] = 0;
+        if (plies == 0) return board.sideToMove() != attacker_ && isMate(board);
+        if (nodes_ > maxNodes_) {
+            aborted_ = true;
+            return false;
+        }
+
+        uint64_t key = 0;
+        chess::Move hashMove = chess::Move::NULL_MOVE;
+        if (UseTable) {
+            key = board.hash();
+            if (MateEntry *entry = probeMate(key)) {
+                if (entry->provenDepth <= plies) {
+                    tableLine(board, plies, ply);
+                    return true;
+                }
+                if (entry->disprovenDepth >= plies) return false;
+                hashMove = entry->best;
+            }
+        }
+
+        bool attacking = board.sideToMove() == attacker_;
+        chess::Movelist ml;
+        mateMoves(board, attacker_, plies, ml);
+        if (ml.empty()) return !attacking && board.inCheck();
+
+        if (UseTable) {
+            if (attacking)
+                orderAttackerMoves(board, ml, hashMove);
+            else
+                orderDefenderMoves(board, ml, hashMove, plies);
+        }
+
+        for (auto m : ml) {
+            board.makeMove(m);
+            bool mate = search<UseTable>(board, plies - 1, ply + 1);
+            board.unmakeMove(m);
+            if (aborted_) return false;
+            if (mate == attacking) {
+                if (attacking) updatePv(ply, m);
+                if (UseTable) storeMate(key, plies, attacking, m);
+                return attacking;
+            }
+        }
+        chess::Move last = ml[ml.size() - 1];
+        if (!attacking) updatePv(ply, last);
+        if (UseTable) storeMate(key, plies, !attacking, attacking ? chess::Move::NULL_MOVE : last);
+        return !attacking;
+    }
+};
+
+#endif
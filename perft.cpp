@@ -0,0 +1,367 @@
+#include<iostream>
+#include "chess.hpp"
+#include "perft.hpp"
+#include<vector>
+#include<string>
+#include<chrono>
+#include<iomanip>
+#include<thread>
+using namespace std;
+using namespace chess;
+
+// Move generator check and benchmark for chess.hpp.
+//
+//   ./perft suite [threads] [hashMB] [depth]
+//   ./perft <depth> [threads] [hashMB] [fen]
+//   ./perft divide <depth> [threads] [hashMB] [fen]
+//   ./perft boards [depth]
+//   ./perft sliders [depth]
+//   ./perft legality [depth]
+//   ./perft batch [depth]
+//
+// The suite runs the PERFT_SUITE positions of perft.hpp at their own depth, or
+// at `depth` for all of them, and compares with the known counts. Threads
+// default to all cores and the hash to 0 MB, i.e. off, so that the Mnps figure
+// measures move generation alone. The fen defaults to the start position.
+// The boards benchmark times makeMove/unmakeMove through the virtual piece
+// hooks (Board) against the statically dispatched SearchBoard and against
+// copy-make with Board::doMove, on one thread with every leaf made, one depth
+// below the suite's. The sliders benchmark runs the suite on one thread with
+// each slider attack backend this build and CPU have (magic, pext) and names
+// the one picked at startup. The legality benchmark times legalmoves against
+// pseudolegalmoves with an isLegal test per move, both bulk counted, on one
+// thread at the suite's depths. The batch benchmark takes every position of
+// the suite's trees to `depth` (default 3) and times, in positions per second,
+// legalmoves, inCheck and both attack sets one Board at a time against
+// PositionBatch::analyze with each kernel this build and CPU have.
+
+double msSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int runSuite(int threads, PerftTable *table, int depth)
+{
+    int failures = 0;
+    uint64_t totalNodes = 0;
+    double totalMs = 0;
+    vector<pair<Move, uint64_t>> counts;
+    for (const auto &pos : PERFT_SUITE) {
+        int d = depth > 0 ? min(depth, 6) : pos.depth;
+        Board board(pos.fen);
+        auto start = chrono::steady_clock::now();
+        uint64_t nodes = divide(board, d, threads, table, counts);
+        double ms = msSince(start);
+        bool ok = nodes == pos.counts[d - 1];
+        failures += !ok;
+        totalNodes += nodes;
+        totalMs += ms;
+        cout << left << setw(11) << pos.name << "depth " << d << right << setw(13) << nodes << "  "
+             << (ok ? "ok  " : "FAIL") << fixed << setprecision(1) << setw(10) << ms << " ms" << setw(9)
+             << perftMnps(nodes, ms) << " Mnps";
+        if (!ok) cout << "  expected " << pos.counts[d - 1];
+        cout << endl;
+    }
+    cout << (failures ? "FAILED " : "all passed, ") << totalNodes << " nodes in " << setprecision(1) << totalMs
+         << " ms, " << perftMnps(totalNodes, totalMs) << " Mnps on " << threads << " threads" << endl;
+    return failures ? 1 : 0;
+}
+
+// One single-threaded run without bulk counting, in ms.
+template <typename BoardT>
+double timeBoard(const Board &root, int depth, uint64_t &nodes)
+{
+    vector<pair<Move, uint64_t>> counts;
+    auto start = chrono::steady_clock::now();
+    nodes = divide<false, BoardT>(root, depth, 1, nullptr, counts);
+    return msSince(start);
+}
+
+double timeCopyMake(const Board &root, int depth, uint64_t &nodes)
+{
+    Board board(root);
+    Position stack[8];
+    stack[0] = board.position();
+    auto start = chrono::steady_clock::now();
+    nodes = perftCopyMake<false>(board, stack, depth);
+    return msSince(start);
+}
+
+// The boards take turns and each keeps its best time, so that a noisy
+// machine slows all of them rather than one. Each line ends with the speedups
+// of SearchBoard and copy-make over Board.
+int compareBoards(int depth)
+{
+    const int rounds = 7;
+    int failures = 0;
+    double boardMs = 0, searchMs = 0, copyMs = 0;
+    uint64_t totalNodes = 0;
+    for (const auto &pos : PERFT_SUITE) {
+        int d = depth > 0 ? min(depth, 6) : pos.depth - 1;
+        Board root(pos.fen);
+        uint64_t boardNodes, searchNodes, copyNodes;
+        double b = 1e18, s = 1e18, c = 1e18;
+        for (int round = 0; round < rounds; round++) {
+            b = min(b, timeBoard<Board>(root, d, boardNodes));
+            s = min(s, timeBoard<SearchBoard>(root, d, searchNodes));
+            c = min(c, timeCopyMake(root, d, copyNodes));
+        }
+        bool ok = boardNodes == pos.counts[d - 1] && searchNodes == pos.counts[d - 1] &&
+                  copyNodes == pos.counts[d - 1];
+        failures += !ok;
+        boardMs += b;
+        searchMs += s;
+        copyMs += c;
+        totalNodes += searchNodes;
+        cout << left << setw(11) << pos.name << "depth " << d << right << setw(11) << searchNodes << "  "
+             << (ok ? "ok  " : "FAIL") << fixed << setprecision(1) << "  Board " << setw(6) << perftMnps(boardNodes, b)
+             << "  SearchBoard " << setw(6) << perftMnps(searchNodes, s) << "  copy-make " << setw(6)
+             << perftMnps(copyNodes, c) << " Mnps  " << setprecision(2) << b / max(s, 1e-3) << "x " << b / max(c, 1e-3)
+             << "x" << endl;
+    }
+    cout << (failures ? "FAILED " : "") << totalNodes << " nodes: Board " << setprecision(1)
+         << perftMnps(totalNodes, boardMs) << " Mnps, SearchBoard " << perftMnps(totalNodes, searchMs)
+         << " Mnps, copy-make " << perftMnps(totalNodes, copyMs) << " Mnps; copy-make is " << setprecision(2)
+         << searchMs / max(copyMs, 1e-3) << "x SearchBoard" << endl;
+    return failures ? 1 : 0;
+}
+
+// Interleaved like compareBoards; the backend picked at startup is restored.
+int compareSliders(int depth)
+{
+    using Backend = attacks::SliderBackend;
+    const Backend active = attacks::sliderBackend();
+    cout << "active slider backend: " << attacks::sliderBackendName(active) << endl;
+
+    vector<Backend> backends;
+    for (Backend b : {Backend::MAGIC, Backend::PEXT}) {
+        if (attacks::hasSliderBackend(b)) backends.push_back(b);
+        else cout << attacks::sliderBackendName(b) << " is not available on this build or CPU" << endl;
+    }
+
+    const int rounds = 5;
+    int failures = 0;
+    vector<double> totalMs(backends.size(), 0);
+    uint64_t totalNodes = 0;
+    vector<pair<Move, uint64_t>> counts;
+    for (const auto &pos : PERFT_SUITE) {
+        int d = depth > 0 ? min(depth, 6) : pos.depth;
+        Board root(pos.fen);
+        vector<double> best(backends.size(), 1e18);
+        for (int round = 0; round < rounds; round++) {
+            for (size_t i = 0; i < backends.size(); i++) {
+                attacks::setSliderBackend(backends[i]);
+                auto start = chrono::steady_clock::now();
+                uint64_t nodes = divide(root, d, 1, nullptr, counts);
+                best[i] = min(best[i], msSince(start));
+                failures += round == 0 && nodes != pos.counts[d - 1];
+                if (round == 0 && i == 0) totalNodes += nodes;
+            }
+        }
+        cout << left << setw(11) << pos.name << "depth " << d << right << setw(11) << pos.counts[d - 1];
+        for (size_t i = 0; i < backends.size(); i++) {
+            totalMs[i] += best[i];
+            cout << "  " << attacks::sliderBackendName(backends[i]) << " " << fixed << setprecision(1) << setw(6)
+                 << perftMnps(pos.counts[d - 1], best[i]) << " Mnps";
+        }
+        cout << endl;
+    }
+    attacks::setSliderBackend(active);
+
+    cout << (failures ? "FAILED " : "") << totalNodes << " nodes:";
+    for (size_t i = 0; i < backends.size(); i++)
+        cout << " " << attacks::sliderBackendName(backends[i]) << " " << setprecision(1)
+             << perftMnps(totalNodes, totalMs[i]) << " Mnps";
+    cout << endl;
+    return failures ? 1 : 0;
+}
+
+// Interleaved like compareBoards.
+int compareLegality(int depth)
+{
+    const int rounds = 5;
+    int failures = 0;
+    double legalMs = 0, pseudoMs = 0;
+    uint64_t totalNodes = 0;
+    for (const auto &pos : PERFT_SUITE) {
+        int d = depth > 0 ? min(depth, 6) : pos.depth;
+        SearchBoard board(pos.fen);
+        uint64_t legalNodes = 0, pseudoNodes = 0;
+        double l = 1e18, p = 1e18;
+        for (int round = 0; round < rounds; round++) {
+            auto start = chrono::steady_clock::now();
+            legalNodes = perft(board, d);
+            l = min(l, msSince(start));
+            start = chrono::steady_clock::now();
+            pseudoNodes = perftPseudoLegal(board, d);
+            p = min(p, msSince(start));
+        }
+        bool ok = legalNodes == pos.counts[d - 1] && pseudoNodes == pos.counts[d - 1];
+        failures += !ok;
+        legalMs += l;
+        pseudoMs += p;
+        totalNodes += pseudoNodes;
+        cout << left << setw(11) << pos.name << "depth " << d << right << setw(11) << pseudoNodes << "  "
+             << (ok ? "ok  " : "FAIL") << fixed << setprecision(1) << "  legal " << setw(6) << perftMnps(legalNodes, l)
+             << "  pseudo-legal " << setw(6) << perftMnps(pseudoNodes, p) << " Mnps  " << setprecision(2)
+             << l / max(p, 1e-3) << "x" << endl;
+    }
+    cout << (failures ? "FAILED " : "") << totalNodes << " nodes: legal " << setprecision(1)
+         << perftMnps(totalNodes, legalMs) << " Mnps, pseudo-legal " << perftMnps(totalNodes, pseudoMs) << " Mnps, "
+         << setprecision(2) << legalMs / max(pseudoMs, 1e-3) << "x" << endl;
+    return failures ? 1 : 0;
+}
+
+// Every position of the tree below board to `depth`, the root included.
+void collectPositions(Board &board, int depth, vector<Position> &positions, PositionBatch &batch)
+{
+    positions.push_back(board.position());
+    batch.add(board);
+    if (depth == 0) return;
+    Movelist ml;
+    movegen::legalmoves<>(ml, board);
+    for (const auto &m : ml) {
+        board.makeMove(m);
+        collectPositions(board, depth - 1, positions, batch);
+        board.unmakeMove(m);
+    }
+}
+
+Bitboard attackedBy(const Board &board, Color color)
+{
+    Bitboard attacked = 0ull;
+    for (Bitboard pieces = board.us(color); pieces;) {
+        const Square sq = pieces.pop();
+        const auto pt = board.at<PieceType>(sq);
+        if (pt == PieceType::PAWN) attacked |= attacks::pawn(color, sq);
+        else if (pt == PieceType::KNIGHT) attacked |= attacks::knight(sq);
+        else if (pt == PieceType::BISHOP) attacked |= attacks::bishop(sq, board.occ());
+        else if (pt == PieceType::ROOK) attacked |= attacks::rook(sq, board.occ());
+        else if (pt == PieceType::QUEEN) attacked |= attacks::queen(sq, board.occ());
+        else attacked |= attacks::king(sq);
+    }
+    return attacked;
+}
+
+struct BatchResult {
+    Bitboard white, black;
+    bool check;
+    int moves;
+};
+
+// Interleaved like compareBoards; each kernel's results are checked against
+// the Board at a time ones.
+int compareBatch(int depth)
+{
+    vector<Position> positions;
+    PositionBatch batch;
+    auto start = chrono::steady_clock::now();
+    for (const auto &pos : PERFT_SUITE) {
+        Board board(pos.fen);
+        collectPositions(board, depth, positions, batch);
+    }
+    cout << positions.size() << " positions from the suite to depth " << depth << ", collected in " << fixed
+         << setprecision(1) << msSince(start) << " ms" << endl;
+
+    using Kernel = PositionBatch::Kernel;
+    vector<Kernel> kernels;
+    for (Kernel k : {Kernel::SCALAR, Kernel::AVX2, Kernel::AVX512}) {
+        if (PositionBatch::hasKernel(k)) kernels.push_back(k);
+        else cout << PositionBatch::kernelName(k) << " is not available on this build or CPU" << endl;
+    }
+
+    vector<BatchResult> expected(positions.size());
+    Board board;
+    const int rounds = 5;
+    double boardMs = 1e18;
+    vector<double> kernelMs(kernels.size(), 1e18);
+    int failures = 0;
+    for (int round = 0; round < rounds; round++) {
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < positions.size(); i++) {
+            board.setPosition(positions[i]);
+            Movelist ml;
+            movegen::legalmoves<>(ml, board);
+            expected[i] = {attackedBy(board, Color::WHITE), attackedBy(board, Color::BLACK), board.inCheck(),
+                           ml.size()};
+        }
+        boardMs = min(boardMs, msSince(start));
+
+        for (size_t k = 0; k < kernels.size(); k++) {
+            start = chrono::steady_clock::now();
+            batch.analyze(kernels[k]);
+            kernelMs[k] = min(kernelMs[k], msSince(start));
+            if (round > 0) continue;
+            for (size_t i = 0; i < positions.size(); i++) {
+                const auto &e = expected[i];
+                failures += batch.attacks(i, Color::WHITE) != e.white || batch.attacks(i, Color::BLACK) != e.black ||
+                            batch.inCheck(i) != e.check || batch.moveCount(i) != e.moves;
+            }
+        }
+    }
+
+    size_t vectorized = 0;
+    for (size_t i = 0; i < batch.size(); i++) vectorized += batch.vectorized(i);
+    auto mpps = [&](double ms) { return positions.size() / max(ms, 1e-3) / 1000.0; };
+    cout << "one Board at a time " << setw(7) << setprecision(2) << mpps(boardMs) << " Mpos/s" << endl;
+    for (size_t k = 0; k < kernels.size(); k++)
+        cout << "batch " << left << setw(14) << PositionBatch::kernelName(kernels[k]) << right << setw(7)
+             << mpps(kernelMs[k]) << " Mpos/s  " << boardMs / max(kernelMs[k], 1e-3) << "x" << endl;
+    cout << (failures ? "FAILED, " : "") << setprecision(1) << 100.0 * vectorized / max<size_t>(batch.size(), 1)
+         << "% of the move counts from the kernel, the rest from legalmoves" << endl;
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " suite [threads] [hashMB] [depth]" << endl
+             << "       " << argv[0] << " boards [depth]" << endl
+             << "       " << argv[0] << " sliders [depth]" << endl
+             << "       " << argv[0] << " legality [depth]" << endl
+             << "       " << argv[0] << " batch [depth]" << endl
+             << "       " << argv[0] << " [divide] <depth> [threads] [hashMB] [fen]" << endl;
+        return 1;
+    }
+    int arg = 1;
+    string mode = argv[arg];
+    if (mode == "boards") return compareBoards(argc > 2 ? stoi(argv[2]) : 0);
+    if (mode == "sliders") return compareSliders(argc > 2 ? stoi(argv[2]) : 0);
+    if (mode == "legality") return compareLegality(argc > 2 ? stoi(argv[2]) : 0);
+    if (mode == "batch") return compareBatch(argc > 2 ? stoi(argv[2]) : 3);
+    if (mode == "suite" || mode == "divide") arg++;
+    int depth = 0;
+    if (mode != "suite") {
+        if (arg >= argc) {
+            cerr << "missing depth" << endl;
+            return 1;
+        }
+        depth = stoi(argv[arg++]);
+    }
+    int threads = arg < argc ? max(1, stoi(argv[arg++])) : max(1u, thread::hardware_concurrency());
+    size_t hashMb = arg < argc ? stoul(argv[arg++]) : 0;
+    unique_ptr<PerftTable> table;
+    if (hashMb > 0) table.reset(new PerftTable(hashMb));
+
+    if (mode == "suite") return runSuite(threads, table.get(), arg < argc ? stoi(argv[arg]) : 0);
+
+    string fen;
+    for (; arg < argc; arg++) fen += (fen.empty() ? "" : " ") + string(argv[arg]);
+    Board board;
+    if (!fen.empty() && !board.setFen(fen)) {
+        cerr << "invalid fen " << fen << endl;
+        return 1;
+    }
+
+    vector<pair<Move, uint64_t>> counts;
+    auto start = chrono::steady_clock::now();
+    uint64_t nodes = divide(board, depth, threads, table.get(), counts);
+    double ms = msSince(start);
+    if (mode == "divide") {
+        for (const auto &c : counts) cout << uci::moveToUci(c.first) << ": " << c.second << endl;
+        cout << endl;
+    }
+    cout << "nodes " << nodes << " time " << fixed << setprecision(1) << ms << " ms, " << perftMnps(nodes, ms)
+         << " Mnps" << endl;
+    return 0;
+}
@@ -0,0 +1,184 @@
+// Perft: counts the leaf nodes of the legal move tree to a fixed depth, to
+// check chess.hpp's move generator against known counts and to time it.
+// The last ply is bulk counted: the size of the legal move list is the number
+// of leaves, so leaf positions are never made. Subtree counts can be cached in
+// a PerftTable, and divide() splits the root moves over threads.
+// Used by perft.cpp and by the perft/divide commands in aethi.cpp.
+#ifndef PERFT_HPP
+#define PERFT_HPP
+
+#include "chess.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Subtree counts keyed by position and depth, shared by all perft threads.
+// Each entry is stored as the key xor'ed with its data next to the data, so a
+// torn write from two threads fails the key check instead of giving a wrong
+// count (the same trick as a lockless transposition table).
+class PerftTable {
+   public:
+    explicit PerftTable(size_t megabytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= megabytes * 1024 * 1024) count *= 2;
+        entries_.reset(new Entry[count]());
+        mask_ = count - 1;
+    }
+
+    bool probe(uint64_t key, int depth, uint64_t &nodes) const {
+        const Entry &entry = entries_[key & mask_];
+        uint64_t data = entry.data.load(std::memory_order_relaxed);
+        uint64_t check = entry.check.load(std::memory_order_relaxed);
+        if ((check ^ data) != key || int(data & 0xFF) != depth) return false;
+        nodes = data >> 8;
+        return true;
+    }
+
+    void store(uint64_t key, int depth, uint64_t nodes) {
+        Entry &entry = entries_[key & mask_];
+        uint64_t data = nodes << 8 | uint64_t(depth);
+        entry.check.store(key ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+
+   private:
+    struct Entry {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+
+    std::unique_ptr<Entry[]> entries_;
+    size_t mask_ = 0;
+};
+
+// BULK = false makes every leaf move as well, which is what the boards
+// benchmark in perft.cpp times.
+template <bool BULK = true, typename BoardT>
+uint64_t perft(BoardT &board, int depth, PerftTable *table = nullptr)
+{
+    if (depth == 0) return 1;
+    chess::Movelist ml;
+    chess::movegen::legalmoves<>(ml, board);
+    if (BULK && depth == 1) return ml.size();
+
+    uint64_t nodes = 0;
+    if (table && table->probe(board.hash(), depth, nodes)) return nodes;
+    for (const auto &m : ml) {
+        board.makeMove(m);
+        nodes += perft<BULK>(board, depth - 1, table);
+        board.unmakeMove(m);
+    }
+    if (table) table->store(board.hash(), depth, nodes);
+    return nodes;
+}
+
+// Copy-make perft: every ply writes its children into the next slot of
+// `stack` with Board::doMove and loads them into `board` for move generation,
+// so nothing is unmade. stack[0] must hold board.position() and the stack
+// needs depth + 1 slots.
+template <bool BULK = true>
+uint64_t perftCopyMake(chess::Board &board, chess::Position *stack, int depth)
+{
+    if (depth == 0) return 1;
+    chess::Movelist ml;
+    chess::movegen::legalmoves<>(ml, board);
+    if (BULK && depth == 1) return ml.size();
+
+    uint64_t nodes = 0;
+    for (const auto &m : ml) {
+        chess::Board::doMove(stack[0], m, stack[1]);
+        board.setPosition(stack[1]);
+        nodes += perftCopyMake<BULK>(board, stack + 1, depth - 1);
+    }
+    board.setPosition(stack[0]);
+    return nodes;
+}
+
+// Perft over movegen::pseudolegalmoves, evasions when in check, testing each
+// move with isLegal; the last ply counts the legal moves without making them.
+template <typename BoardT>
+uint64_t perftPseudoLegal(BoardT &board, int depth)
+{
+    if (depth == 0) return 1;
+    const auto info = chess::movegen::legalityInfo(board);
+    chess::Movelist ml;
+    if (info.checkers) chess::movegen::pseudolegalmoves<chess::movegen::MoveGenType::EVASIONS>(ml, board);
+    else chess::movegen::pseudolegalmoves<>(ml, board);
+
+    uint64_t nodes = 0;
+    for (const auto &m : ml) {
+        if (!chess::movegen::isLegal(board, info, m)) continue;
+        if (depth == 1) {
+            nodes++;
+            continue;
+        }
+        board.makeMove(m);
+        nodes += perftPseudoLegal(board, depth - 1);
+        board.unmakeMove(m);
+    }
+    return nodes;
+}
+
+// Perft with the count below every root move. Threads take root moves one at
+// a time, each on its own copy of the board.
+template <bool BULK = true, typename BoardT = chess::SearchBoard>
+uint64_t divide(const chess::Board &root, int depth, int threads, PerftTable *table,
+                std::vector<std::pair<chess::Move, uint64_t>> &counts)
+{
+    counts.clear();
+    if (depth < 1) return 1;
+    chess::Movelist ml;
+    chess::movegen::legalmoves<>(ml, root);
+    counts.assign(ml.size(), {chess::Move::NO_MOVE, 0});
+
+    std::atomic<size_t> next(0);
+    auto worker = [&] {
+        BoardT board(root);
+        for (size_t i = next++; i < size_t(ml.size()); i = next++) {
+            board.makeMove(ml[i]);
+            counts[i] = {ml[i], perft<BULK>(board, depth - 1, table)};
+            board.unmakeMove(ml[i]);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads && t < (int)ml.size(); t++) pool.emplace_back(worker);
+    worker();
+    for (auto &th : pool) th.join();
+
+    uint64_t nodes = 0;
+    for (const auto &c : counts) nodes += c.second;
+    return nodes;
+}
+
+inline double perftMnps(uint64_t nodes, double ms) { return nodes / std::max(ms, 1e-3) / 1000.0; }
+
+// Positions from the Chess Programming Wiki's perft results page, chosen to
+// cover castling, en passant, promotions and discovered checks. counts[d - 1]
+// is the expected perft at depth d; `depth` is the depth the suite runs.
+struct PerftPosition {
+    const char *name;
+    const char *fen;
+    int depth;
+    uint64_t counts[6];
+};
+
+const PerftPosition PERFT_SUITE[] = {
+    {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5,
+     {20, 400, 8902, 197281, 4865609, 119060324}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4,
+     {48, 2039, 97862, 4085603, 193690690, 8031647685ULL}},
+    {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6,
+     {14, 191, 2812, 43238, 674624, 11030083}},
+    {"position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5,
+     {6, 264, 9467, 422333, 15833292, 706045033}},
+    {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4,
+     {44, 1486, 62379, 2103487, 89941194, 3048196529ULL}},
+    {"position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4,
+     {46, 2079, 89890, 3894594, 164075551, 6923051137ULL}},
+};
+
+#endif
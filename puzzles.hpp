@@ -0,0 +1,188 @@
+// Mate puzzles from the Week3 collections.
+// Two formats are read, both as streams:
+//  - mate_in_N.json: a single flat object mapping each FEN to its solution in
+//    SAN, with or without move numbers ("Rxh7+ Kxh7 Rh5#",
+//    "1... Bc5+ 2. Kxc5 Qb6+ 3. Kd5 Qd6#").
+//  - m8nN.txt: blocks of a game citation, a FEN line and a solution line.
+// Positions are stored as 24-byte PackedBoards and solutions as moves parsed
+// once at load time, all in flat arrays. Some solutions give only the key
+// move, so the mate length is taken from the file name when it has one.
+#ifndef PUZZLES_HPP
+#define PUZZLES_HPP
+
+#include "chess.hpp"
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+struct Puzzle {
+    chess::PackedBoard position;
+    uint32_t solutionBegin;  // into PuzzleSet::moves
+    uint8_t solutionCount;
+    uint8_t mateIn;
+    uint16_t file;           // into PuzzleSet::files
+    uint32_t index;          // 1-based position within its file
+};
+
+struct PuzzleSet {
+    std::vector<Puzzle> puzzles;
+    std::vector<chess::Move> moves;
+    std::vector<std::string> files;
+    int unparsedMoves = 0;   // solution moves that were not legal SAN
+
+    size_t size() const { return puzzles.size(); }
+
+    chess::Board board(size_t i) const { return chess::Board::Compact::decode(puzzles[i].position); }
+
+    const chess::Move *solution(size_t i) const { return moves.data() + puzzles[i].solutionBegin; }
+
+    std::string source(size_t i) const { return files[puzzles[i].file] + ":" + std::to_string(puzzles[i].index); }
+
+    bool load(const std::string &path);
+    bool loadJson(std::istream &in, int mateIn);
+    bool loadText(std::istream &in, int mateIn);
+
+   private:
+    uint32_t fileIndex = 0;
+
+    void add(const std::string &fen, const std::string &solution, int mateIn);
+};
+
+// Splits a solution into its SAN moves, dropping move numbers and results.
+inline std::vector<std::string> solutionMoves(const std::string &text)
+{
+    std::vector<std::string> moves;
+    std::stringstream ss(text);
+    std::string token;
+    while (ss >> token) {
+        if (token.find('.') != std::string::npos) token = token.substr(token.find_last_of('.') + 1);
+        // A few solutions write promotions as "e8/Q".
+        size_t slash = token.find('/');
+        if (slash == 2 && slash + 1 < token.size() && isupper((unsigned char)token[slash + 1])) token[slash] = '=';
+        if (token.empty() || token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") continue;
+        moves.push_back(token);
+    }
+    return moves;
+}
+
+// Mate length from names like mate_in_3.json or m8n3.txt, or 0.
+inline int mateInFromName(const std::string &name)
+{
+    for (const char *tag : {"mate_in_", "m8n"}) {
+        size_t pos = name.find(tag);
+        if (pos != std::string::npos) return atoi(name.c_str() + pos + strlen(tag));
+    }
+    return 0;
+}
+
+// Parses the solution against the position for as long as it is legal SAN.
+// Puzzles with an invalid FEN are skipped.
+inline void PuzzleSet::add(const std::string &fen, const std::string &solution, int mateIn)
+{
+    chess::Board board;
+    if (!board.setFen(fen)) return;
+
+    Puzzle p;
+    p.position = chess::Board::Compact::encode(board);
+    p.solutionBegin = moves.size();
+    p.solutionCount = 0;
+    for (const auto &san : solutionMoves(solution)) {
+        chess::Move m = chess::Move::NO_MOVE;
+        try {
+            m = chess::uci::parseSan(board, san);
+        } catch (...) {
+        }
+        if (m == chess::Move::NO_MOVE) {
+            unparsedMoves++;
+            break;
+        }
+        moves.push_back(m);
+        board.makeMove(m);
+        p.solutionCount++;
+    }
+    p.mateIn = mateIn > 0 ? mateIn : (p.solutionCount + 1) / 2;
+    p.file = files.size() - 1;
+    p.index = ++fileIndex;
+    puzzles.push_back(p);
+}
+
+// Reads one JSON string whose opening quote has just been consumed.
+inline bool readJsonString(std::istream &in, std::string &out)
+{
+    out.clear();
+    char ch;
+    while (in.get(ch)) {
+        if (ch == '"') return true;
+        if (ch == '\\' && !in.get(ch)) return false;
+        out += ch;
+    }
+    return false;
+}
+
+// Skips whitespace and commas and returns the next character without consuming it.
+inline int nextJsonToken(std::istream &in)
+{
+    int ch;
+    while ((ch = in.peek()) != EOF && (isspace(ch) || ch == ',')) in.get();
+    return ch;
+}
+
+inline bool PuzzleSet::loadJson(std::istream &in, int mateIn)
+{
+    if (nextJsonToken(in) != '{') return false;
+    in.get();
+    std::string fen, solution;
+    while (true) {
+        int ch = nextJsonToken(in);
+        if (ch == '}') return true;
+        if (ch != '"') return false;
+        in.get();
+        if (!readJsonString(in, fen) || nextJsonToken(in) != ':') return false;
+        in.get();
+        if (nextJsonToken(in) != '"') return false;
+        in.get();
+        if (!readJsonString(in, solution)) return false;
+        add(fen, solution, mateIn);
+    }
+}
+
+// A FEN line is recognised by its seven rank separators; the next non-empty
+// line is its solution and everything else is commentary.
+inline bool PuzzleSet::loadText(std::istream &in, int mateIn)
+{
+    std::string line, fen;
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos) continue;
+        line = line.substr(start, line.find_last_not_of(" \t\r") - start + 1);
+        if (!fen.empty()) {
+            add(fen, line, mateIn);
+            fen.clear();
+            continue;
+        }
+        size_t space = line.find(' ');
+        if (space != std::string::npos && std::count(line.begin(), line.begin() + space, '/') == 7) fen = line;
+    }
+    return true;
+}
+
+// Picks the format from the extension. Returns false if the file cannot be
+// read or the JSON is malformed; puzzles before the error are kept.
+inline bool PuzzleSet::load(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    files.push_back(name);
+    fileIndex = 0;
+    int mateIn = mateInFromName(name);
+    if (name.size() >= 5 && name.substr(name.size() - 5) == ".json") return loadJson(in, mateIn);
+    return loadText(in, mateIn);
+}
+
+#endif
@@ -0,0 +1,93 @@
+#include<iostream>
+#include<vector>
+#include<string>
+#include<chrono>
+#include<algorithm>
+#include<iomanip>
+#include<unistd.h>
+#include<sys/wait.h>
+using namespace std;
+
+// Startup latency of UCI engines: the time from starting the process to
+// reading "uciok", as a puzzle batch or tournament runner that launches an
+// engine per game sees it.
+//
+//   ./startup [runs] <engine> [engine ...]
+//
+// Engines run in turns and each reports its fastest and median run, so a
+// noisy machine slows all of them rather than one. Compare e.g. aethi built
+// with and without -DCHESS_CONSTEXPR_TABLES. POSIX only.
+
+// One run in microseconds, or a negative number if the engine never said uciok.
+double timeToUciok(const string &engine)
+{
+    int toEngine[2], fromEngine[2];
+    if (pipe(toEngine) != 0 || pipe(fromEngine) != 0) return -1;
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        dup2(toEngine[0], STDIN_FILENO);
+        dup2(fromEngine[1], STDOUT_FILENO);
+        close(toEngine[1]);
+        close(fromEngine[0]);
+        execl(engine.c_str(), engine.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    close(toEngine[0]);
+    close(fromEngine[1]);
+
+    const string uci = "uci\n";
+    bool ok = write(toEngine[1], uci.data(), uci.size()) == (ssize_t)uci.size();
+    string output;
+    char buffer[4096];
+    double us = -1;
+    while (ok) {
+        ssize_t n = read(fromEngine[0], buffer, sizeof(buffer));
+        if (n <= 0) break;
+        output.append(buffer, n);
+        if (output.find("uciok") != string::npos) {
+            us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+            break;
+        }
+    }
+
+    const string quit = "quit\n";
+    if (write(toEngine[1], quit.data(), quit.size()) < 0) us = -1;
+    close(toEngine[1]);
+    close(fromEngine[0]);
+    waitpid(pid, nullptr, 0);
+    return us;
+}
+
+int main(int argc, char **argv)
+{
+    int arg = 1;
+    int runs = 50;
+    if (arg < argc && isdigit(argv[arg][0])) runs = max(1, stoi(argv[arg++]));
+    if (arg >= argc) {
+        cerr << "usage: " << argv[0] << " [runs] <engine> [engine ...]" << endl;
+        return 1;
+    }
+    vector<string> engines(argv + arg, argv + argc);
+
+    vector<vector<double>> times(engines.size());
+    for (int run = 0; run < runs; run++) {
+        for (size_t i = 0; i < engines.size(); i++) {
+            double us = timeToUciok(engines[i]);
+            if (us < 0) {
+                cerr << engines[i] << " did not answer uciok" << endl;
+                return 1;
+            }
+            times[i].push_back(us);
+        }
+    }
+
+    for (size_t i = 0; i < engines.size(); i++) {
+        sort(times[i].begin(), times[i].end());
+        cout << left << setw(30) << engines[i] << right << fixed << setprecision(0) << " min " << setw(7)
+             << times[i].front() << " us  median " << setw(7) << times[i][times[i].size() / 2] << " us" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,845 @@
+// Syzygy endgame tablebases: WDL (win/draw/loss) and DTZ (distance to zeroing,
+// the plies to the next capture or pawn move) probing of the .rtbw/.rtbz files
+// of the usual 3-4-5 (and 6-7) piece sets. A table is memory-mapped read-only
+// the first time it is probed.
+//
+// The decoder follows the file format as read by Fathom and Stockfish's
+// tbprobe: each table is split by side to move and, with pawns, by the file of
+// the leading pawn; positions are indexed with the board's symmetries folded
+// out, and the values are canonical Huffman codes over "recursive pairing"
+// symbols, stored in blocks that a sparse index points into.
+//
+// Results are for the side to move and follow the 50-move rule: a cursed win
+// is a win the 50-move rule turns into a draw, a blessed loss a loss it saves.
+// Positions with castling rights are never probed.
+#ifndef TABLEBASE_HPP
+#define TABLEBASE_HPP
+
+#include "chess.hpp"
+#include "endgame.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum TbWdl { TB_LOSS = -2, TB_BLESSED_LOSS = -1, TB_DRAW = 0, TB_CURSED_WIN = 1, TB_WIN = 2 };
+
+const int TB_MAX_PIECES = 7;
+
+namespace tbdetail {
+
+enum Type { WDL, DTZ };
+enum Flag { STM = 1, MAPPED = 2, WIN_PLIES = 4, LOSS_PLIES = 8, WIDE = 16, SINGLE_VALUE = 128 };
+enum State { FAIL, OK, CHANGE_STM, ZEROING_BEST_MOVE };
+
+inline uint16_t readLE16(const uint8_t *p) { return uint16_t(p[0] | p[1] << 8); }
+inline uint32_t readLE32(const uint8_t *p) { return uint32_t(readLE16(p)) | uint32_t(readLE16(p + 2)) << 16; }
+inline uint32_t readBE32(const uint8_t *p) { return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]; }
+inline uint64_t readBE64(const uint8_t *p) { return uint64_t(readBE32(p)) << 32 | readBE32(p + 4); }
+
+// rank - file: negative below the a1-h8 diagonal, zero on it.
+inline int offA1H8(int sq) { return (sq >> 3) - (sq & 7); }
+
+// The index tables of the format, built on first use.
+struct Maps {
+    int pawns[64] = {};        // a2-h7 to 47..0, edge files and low ranks first
+    int b1h1h7[64] = {};       // the squares below the a1-h8 diagonal to 0..27
+    int a1d1d4[64] = {};       // the a1-d1-d4 triangle to 0..9, diagonal last
+    int kk[10][64] = {};       // the 462 placements of two kings
+    uint64_t binomial[7][64] = {};
+    uint64_t leadPawnIdx[6][64] = {};
+    uint64_t leadPawnsSize[6][4] = {};
+
+    Maps() {
+        int code = 0;
+        for (int sq = 0; sq < 64; sq++) {
+            if (offA1H8(sq) < 0) b1h1h7[sq] = code++;
+        }
+
+        const int triangle[] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+        std::vector<int> diagonal;
+        code = 0;
+        for (int sq : triangle) {
+            if (offA1H8(sq) < 0) a1d1d4[sq] = code++;
+            else diagonal.push_back(sq);
+        }
+        for (int sq : diagonal) a1d1d4[sq] = code++;
+
+        // With the first king on the diagonal the second one is not above it;
+        // placements with both on the diagonal come last.
+        std::vector<std::pair<int, int>> bothOnDiagonal;
+        code = 0;
+        for (int idx = 0; idx < 10; idx++) {
+            for (int s1 = 0; s1 <= 27; s1++) {
+                if (a1d1d4[s1] != idx || (idx == 0 && s1 != 1)) continue;
+                for (int s2 = 0; s2 < 64; s2++) {
+                    if (std::abs((s1 & 7) - (s2 & 7)) <= 1 && std::abs((s1 >> 3) - (s2 >> 3)) <= 1) continue;
+                    if (!offA1H8(s1) && offA1H8(s2) > 0) continue;
+                    if (!offA1H8(s1) && !offA1H8(s2)) bothOnDiagonal.emplace_back(idx, s2);
+                    else kk[idx][s2] = code++;
+                }
+            }
+        }
+        for (const auto &p : bothOnDiagonal) kk[p.first][p.second] = code++;
+
+        binomial[0][0] = 1;
+        for (int n = 1; n < 64; n++) {
+            for (int k = 0; k < 7 && k <= n; k++) {
+                binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) + (k < n ? binomial[k][n - 1] : 0);
+            }
+        }
+
+        // The leading pawn is the one with the highest pawns[] value; with it
+        // on a square, the other pawns of its group have pawns[sq] squares left.
+        int available = 47;
+        for (int leadPawns = 1; leadPawns <= 5; leadPawns++) {
+            for (int file = 0; file < 4; file++) {
+                uint64_t idx = 0;
+                for (int rank = 1; rank <= 6; rank++) {
+                    int sq = rank * 8 + file;
+                    if (leadPawns == 1) {
+                        pawns[sq] = available--;
+                        pawns[sq ^ 7] = available--;
+                    }
+                    leadPawnIdx[leadPawns][sq] = idx;
+                    idx += binomial[leadPawns - 1][pawns[sq]];
+                }
+                leadPawnsSize[leadPawns][file] = idx;
+            }
+        }
+    }
+};
+
+inline const Maps &maps()
+{
+    static const Maps m;
+    return m;
+}
+
+// One compressed table: a side to move, and with pawns a leading pawn file.
+struct Pairs {
+    uint8_t flags = 0;
+    int maxSymLen = 0;
+    int minSymLen = 0;              // or the value itself with SINGLE_VALUE
+    uint32_t numBlocks = 0;
+    uint64_t blockSize = 0;
+    uint64_t span = 0;              // a sparse index entry every span values
+    const uint8_t *lowestSym = nullptr;
+    const uint8_t *btree = nullptr; // two 12-bit child symbols per symbol
+    const uint8_t *blockLength = nullptr;
+    uint32_t blockLengthSize = 0;
+    const uint8_t *sparseIndex = nullptr;
+    uint64_t sparseIndexSize = 0;
+    const uint8_t *data = nullptr;
+    std::vector<uint64_t> base64;   // lowest code of each length, left-aligned
+    std::vector<uint16_t> symlen;   // values a symbol expands to, minus one
+    int pieces[TB_MAX_PIECES] = {}; // 1-6 white pawn to king, 9-14 black
+    uint64_t groupIdx[TB_MAX_PIECES + 1] = {};
+    int groupLen[TB_MAX_PIECES + 1] = {};
+    uint32_t mapIdx[4] = {};        // DTZ value maps: win, loss, cursed win, blessed loss
+};
+
+inline int symLeft(const uint8_t *btree, int sym) { return (btree[3 * sym + 1] & 0xF) << 8 | btree[3 * sym]; }
+inline int symRight(const uint8_t *btree, int sym) { return btree[3 * sym + 2] << 4 | btree[3 * sym + 1] >> 4; }
+
+struct File {
+    std::string path;
+    std::once_flag once;
+    bool ok = false;
+    void *map = nullptr;
+    size_t mapSize = 0;
+    const uint8_t *dtzMap = nullptr;
+    Pairs items[2][4]; // [side to move][leading pawn file]
+};
+
+struct Table {
+    std::string code;   // e.g. KRPvKR, the strong side first
+    uint64_t key = 0;   // endgame.hpp material keys with the strong side White
+    uint64_t key2 = 0;  // and Black
+    int pieceCount = 0;
+    bool hasPawns = false;
+    bool hasUniquePieces = false;
+    int pawnCount[2] = {}; // leading colour, other colour
+    File files[2];         // WDL, DTZ
+
+    Pairs *get(Type type, int stm, int file) {
+        return &files[type].items[type == WDL ? stm : 0][hasPawns ? file : 0];
+    }
+    ~Table() {
+        for (auto &f : files) {
+            if (f.map) munmap(f.map, f.mapSize);
+        }
+    }
+};
+
+// Expands a symbol's pair of children to count the values it stands for.
+inline int setSymlen(Pairs *d, int sym, std::vector<bool> &visited)
+{
+    visited[sym] = true;
+    int right = symRight(d->btree, sym);
+    if (right == 0xFFF) return 0;
+    int left = symLeft(d->btree, sym);
+    if (!visited[left]) d->symlen[left] = setSymlen(d, left, visited);
+    if (!visited[right]) d->symlen[right] = setSymlen(d, right, visited);
+    return d->symlen[left] + d->symlen[right] + 1;
+}
+
+// Splits the pieces into groups encoded together (the leading group, then
+// pieces of one type and colour) and sets the index stride of each group; the
+// file says in which order the groups are multiplied out.
+inline void setGroups(const Table &t, Pairs *d, const int order[2], int file)
+{
+    const Maps &m = maps();
+    int n = 0, firstLen = t.hasPawns ? 0 : t.hasUniquePieces ? 3 : 2;
+    d->groupLen[n] = 1;
+    for (int i = 1; i < t.pieceCount; i++) {
+        if (--firstLen > 0 || d->pieces[i] == d->pieces[i - 1]) d->groupLen[n]++;
+        else d->groupLen[++n] = 1;
+    }
+    d->groupLen[++n] = 0;
+
+    bool pp = t.hasPawns && t.pawnCount[1];
+    int next = pp ? 2 : 1;
+    int freeSquares = 64 - d->groupLen[0] - (pp ? d->groupLen[1] : 0);
+    uint64_t idx = 1;
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k++) {
+        if (k == order[0]) {
+            d->groupIdx[0] = idx;
+            idx *= t.hasPawns ? m.leadPawnsSize[d->groupLen[0]][file] : t.hasUniquePieces ? 31332 : 462;
+        } else if (k == order[1]) {
+            d->groupIdx[1] = idx;
+            idx *= m.binomial[d->groupLen[1]][48 - d->groupLen[0]];
+        } else {
+            d->groupIdx[next] = idx;
+            idx *= m.binomial[d->groupLen[next]][freeSquares];
+            freeSquares -= d->groupLen[next++];
+        }
+    }
+    d->groupIdx[n] = idx;
+}
+
+inline const uint8_t *setSizes(Pairs *d, const uint8_t *data)
+{
+    d->flags = *data++;
+    if (d->flags & SINGLE_VALUE) {
+        d->minSymLen = *data++;
+        return data;
+    }
+
+    int groups = 0;
+    while (d->groupLen[groups]) groups++;
+    uint64_t tbSize = d->groupIdx[groups];
+
+    d->blockSize = uint64_t(1) << *data++;
+    d->span = uint64_t(1) << *data++;
+    d->sparseIndexSize = (tbSize + d->span - 1) / d->span;
+    int padding = *data++;
+    d->numBlocks = readLE32(data);
+    data += 4;
+    d->blockLengthSize = d->numBlocks + padding;
+    d->maxSymLen = *data++;
+    d->minSymLen = *data++;
+    d->lowestSym = data;
+
+    // Canonical Huffman: longer codes have lower values, and the codes of one
+    // length are consecutive from base64[length - minSymLen].
+    d->base64.assign(d->maxSymLen - d->minSymLen + 1, 0);
+    for (int i = int(d->base64.size()) - 2; i >= 0; i--) {
+        d->base64[i] = (d->base64[i + 1] + readLE16(d->lowestSym + 2 * i) - readLE16(d->lowestSym + 2 * (i + 1))) / 2;
+    }
+    for (size_t i = 0; i < d->base64.size(); i++) d->base64[i] <<= 64 - i - d->minSymLen;
+    data += d->base64.size() * 2;
+
+    d->symlen.assign(readLE16(data), 0);
+    data += 2;
+    d->btree = data;
+    std::vector<bool> visited(d->symlen.size());
+    for (size_t sym = 0; sym < d->symlen.size(); sym++) {
+        if (!visited[sym]) d->symlen[sym] = setSymlen(d, int(sym), visited);
+    }
+    return data + d->symlen.size() * 3 + (d->symlen.size() & 1);
+}
+
+// DTZ values are stored as ranks by frequency; the maps turn them back.
+inline const uint8_t *setDtzMap(Table &t, const uint8_t *data, int maxFile)
+{
+    File &f = t.files[DTZ];
+    f.dtzMap = data;
+    for (int file = 0; file <= maxFile; file++) {
+        Pairs *d = t.get(DTZ, 0, file);
+        if (!(d->flags & MAPPED)) continue;
+        if (d->flags & WIDE) {
+            data += uintptr_t(data) & 1;
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = uint32_t(data - f.dtzMap + 2);
+                data += 2 * readLE16(data) + 2;
+            }
+        } else {
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = uint32_t(data - f.dtzMap + 1);
+                data += *data + 1;
+            }
+        }
+    }
+    return data + (uintptr_t(data) & 1);
+}
+
+inline bool setup(Table &t, Type type, const uint8_t *data, const uint8_t *end)
+{
+    enum { SPLIT = 1, HAS_PAWNS = 2 };
+    if (bool(*data & HAS_PAWNS) != t.hasPawns) return false;
+    if (type == WDL && bool(*data & SPLIT) != (t.key != t.key2)) return false;
+    data++;
+
+    File &f = t.files[type];
+    const int sides = type == WDL && t.key != t.key2 ? 2 : 1;
+    const int maxFile = t.hasPawns ? 3 : 0;
+    const bool pp = t.hasPawns && t.pawnCount[1];
+
+    for (int file = 0; file <= maxFile; file++) {
+        int order[2][2] = {{data[0] & 0xF, pp ? data[1] & 0xF : 0xF}, {data[0] >> 4, pp ? data[1] >> 4 : 0xF}};
+        data += 1 + pp;
+        for (int k = 0; k < t.pieceCount; k++, data++) {
+            for (int i = 0; i < sides; i++) f.items[i][file].pieces[k] = i ? *data >> 4 : *data & 0xF;
+        }
+        for (int i = 0; i < sides; i++) setGroups(t, &f.items[i][file], order[i], file);
+    }
+    data += uintptr_t(data) & 1;
+
+    for (int file = 0; file <= maxFile; file++) {
+        for (int i = 0; i < sides; i++) data = setSizes(&f.items[i][file], data);
+    }
+    if (type == DTZ) data = setDtzMap(t, data, maxFile);
+
+    for (int file = 0; file <= maxFile; file++) {
+        for (int i = 0; i < sides; i++) {
+            f.items[i][file].sparseIndex = data;
+            data += f.items[i][file].sparseIndexSize * 6;
+        }
+    }
+    for (int file = 0; file <= maxFile; file++) {
+        for (int i = 0; i < sides; i++) {
+            f.items[i][file].blockLength = data;
+            data += f.items[i][file].blockLengthSize * 2;
+        }
+    }
+    for (int file = 0; file <= maxFile; file++) {
+        for (int i = 0; i < sides; i++) {
+            data = reinterpret_cast<const uint8_t *>((uintptr_t(data) + 0x3F) & ~uintptr_t(0x3F));
+            f.items[i][file].data = data;
+            data += uint64_t(f.items[i][file].numBlocks) * f.items[i][file].blockSize;
+        }
+    }
+    return data <= end;
+}
+
+// Maps the file on first use. Returns false if it is missing or corrupt.
+inline bool mapped(Table &t, Type type)
+{
+    File &f = t.files[type];
+    std::call_once(f.once, [&] {
+        static const uint8_t magics[2][4] = {{0x71, 0xE8, 0x23, 0x5D}, {0xD7, 0x66, 0x0C, 0xA5}};
+        if (f.path.empty()) return;
+        int fd = open(f.path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size % 64 != 16) {
+            close(fd);
+            return;
+        }
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return;
+        f.map = map;
+        f.mapSize = st.st_size;
+
+        const uint8_t *data = static_cast<const uint8_t *>(map);
+        f.ok = memcmp(data, magics[type], 4) == 0 && setup(t, type, data + 4, data + st.st_size);
+    });
+    return f.ok;
+}
+
+inline int decompress(const Pairs *d, uint64_t idx)
+{
+    if (d->flags & SINGLE_VALUE) return d->minSymLen;
+
+    // The sparse index gives the block and offset of the value in the middle
+    // of every span; walk from there to the block holding idx.
+    const uint8_t *sparse = d->sparseIndex + 6 * (idx / d->span);
+    uint32_t block = readLE32(sparse);
+    int offset = readLE16(sparse + 4) + int(idx % d->span) - int(d->span / 2);
+    while (offset < 0) offset += readLE16(d->blockLength + 2 * --block) + 1;
+    while (offset > readLE16(d->blockLength + 2 * block)) offset -= readLE16(d->blockLength + 2 * block++) + 1;
+
+    // Decode symbols from the start of the block until the one covering offset.
+    const uint8_t *ptr = d->data + uint64_t(block) * d->blockSize;
+    uint64_t buf64 = readBE64(ptr);
+    ptr += 8;
+    int buf64Size = 64;
+    int sym;
+    while (true) {
+        int len = 0;
+        while (buf64 < d->base64[len]) len++;
+        sym = int((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
+        sym += readLE16(d->lowestSym + 2 * len);
+        if (offset < d->symlen[sym] + 1) break;
+        offset -= d->symlen[sym] + 1;
+        len += d->minSymLen;
+        buf64 <<= len;
+        buf64Size -= len;
+        if (buf64Size <= 32) {
+            buf64Size += 32;
+            buf64 |= uint64_t(readBE32(ptr)) << (64 - buf64Size);
+            ptr += 4;
+        }
+    }
+
+    // Then descend the symbol's pairs to the value at offset.
+    while (d->symlen[sym]) {
+        int left = symLeft(d->btree, sym);
+        if (offset < d->symlen[left] + 1) {
+            sym = left;
+        } else {
+            offset -= d->symlen[left] + 1;
+            sym = symRight(d->btree, sym);
+        }
+    }
+    return symLeft(d->btree, sym);
+}
+
+inline bool pawnsBefore(int a, int b) { return maps().pawns[a] < maps().pawns[b]; }
+
+// Index of a position given in the table's colours: the leading pawns first
+// (squares[0] the leading one), then the other pieces in any order.
+inline uint64_t encode(const Table &t, const Pairs *d, int *squares, int *pieces, int size, int leadPawns)
+{
+    const Maps &m = maps();
+
+    // Order the pieces as the table lists them.
+    for (int i = leadPawns; i < size - 1; i++) {
+        for (int j = i + 1; j < size; j++) {
+            if (d->pieces[i] == pieces[j]) {
+                std::swap(pieces[i], pieces[j]);
+                std::swap(squares[i], squares[j]);
+                break;
+            }
+        }
+    }
+
+    // Mirror the leading piece into files a-d.
+    if ((squares[0] & 7) > 3) {
+        for (int i = 0; i < size; i++) squares[i] ^= 7;
+    }
+
+    uint64_t idx;
+    if (t.hasPawns) {
+        idx = m.leadPawnIdx[leadPawns][squares[0]];
+        std::stable_sort(squares + 1, squares + leadPawns, pawnsBefore);
+        for (int i = 1; i < leadPawns; i++) idx += m.binomial[i][m.pawns[squares[i]]];
+    } else {
+        // Without pawns also into ranks 1-4, and the first piece of the
+        // leading group off the a1-h8 diagonal to below it.
+        if ((squares[0] >> 3) > 3) {
+            for (int i = 0; i < size; i++) squares[i] ^= 56;
+        }
+        for (int i = 0; i < d->groupLen[0]; i++) {
+            if (!offA1H8(squares[i])) continue;
+            if (offA1H8(squares[i]) > 0) {
+                for (int j = i; j < size; j++) squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+            }
+            break;
+        }
+
+        if (t.hasUniquePieces) {
+            int adjust1 = squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+            if (offA1H8(squares[0])) {
+                idx = (m.a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            } else if (offA1H8(squares[1])) {
+                idx = (6 * 63 + (squares[0] >> 3) * 28 + m.b1h1h7[squares[1]]) * 62 + squares[2] - adjust2;
+            } else if (offA1H8(squares[2])) {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + (squares[0] >> 3) * 7 * 28 + ((squares[1] >> 3) - adjust1) * 28
+                      + m.b1h1h7[squares[2]];
+            } else {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (squares[0] >> 3) * 7 * 6
+                      + ((squares[1] >> 3) - adjust1) * 6 + ((squares[2] >> 3) - adjust2);
+            }
+        } else {
+            idx = m.kk[m.a1d1d4[squares[0]]][squares[1]];
+        }
+    }
+    idx *= d->groupIdx[0];
+
+    // The other groups, each as a combination of the squares not taken by
+    // earlier groups (the other side's pawns only from ranks 2-7).
+    int *groupSq = squares + d->groupLen[0];
+    bool remainingPawns = t.hasPawns && t.pawnCount[1];
+    for (int next = 1; d->groupLen[next]; next++) {
+        std::stable_sort(groupSq, groupSq + d->groupLen[next]);
+        uint64_t n = 0;
+        for (int i = 0; i < d->groupLen[next]; i++) {
+            int adjust = int(std::count_if(squares, groupSq, [&](int sq) { return groupSq[i] > sq; }));
+            n += m.binomial[i + 1][groupSq[i] - adjust - 8 * remainingPawns];
+        }
+        remainingPawns = false;
+        idx += n * d->groupIdx[next];
+        groupSq += d->groupLen[next];
+    }
+    return idx;
+}
+
+inline int mapScore(Table &t, Type type, int file, int value, int wdl)
+{
+    if (type == WDL) return value - 2;
+
+    static const int wdlMap[] = {1, 3, 0, 2, 0};
+    const Pairs *d = t.get(DTZ, 0, file);
+    if (d->flags & MAPPED) {
+        uint32_t i = d->mapIdx[wdlMap[wdl + 2]];
+        const uint8_t *map = t.files[DTZ].dtzMap;
+        value = d->flags & WIDE ? readLE16(map + i + 2 * value) : map[i + value];
+    }
+    // Stored in moves unless the flags say plies.
+    if ((wdl == TB_WIN && !(d->flags & WIN_PLIES)) || (wdl == TB_LOSS && !(d->flags & LOSS_PLIES))
+        || wdl == TB_CURSED_WIN || wdl == TB_BLESSED_LOSS) {
+        value *= 2;
+    }
+    return value + 1;
+}
+
+inline int pieceCode(chess::Piece p) { return int(p.type()) + 1 + (p.color() == chess::Color::BLACK ? 8 : 0); }
+
+// The raw table value for the position: WDL, or DTZ given its WDL. Tables
+// are stored with the strong side White, so a position with Black strong is
+// probed colour-flipped; a DTZ table holds one side to move only.
+inline int probeTable(const chess::Board &board, Table &t, Type type, int wdl, State &state);
+
+}  // namespace tbdetail
+
+// The tables found by tbInit(), under the material keys of both colourings.
+inline std::vector<std::unique_ptr<tbdetail::Table>> tbTableList;
+inline std::unordered_map<uint64_t, tbdetail::Table *> tbTables;
+inline int tbLargest = 0;
+inline uint64_t tbHits = 0;
+
+inline int tbdetail::probeTable(const chess::Board &board, Table &t, Type type, int wdl, State &state)
+{
+    if (!mapped(t, type)) {
+        state = FAIL;
+        return 0;
+    }
+
+    int squares[TB_MAX_PIECES], pieces[TB_MAX_PIECES];
+    int size = 0, leadPawns = 0, file = 0;
+    chess::Bitboard leadPawnsBb = 0;
+
+    const bool blackToMove = board.sideToMove() == chess::Color::BLACK;
+    // With the same material on both sides only White to move is stored.
+    const bool flip = (t.key == t.key2 && blackToMove) || materialKey(board) != t.key;
+    const int flipColor = flip ? 8 : 0, flipSquares = flip ? 56 : 0;
+    const int stm = flip != blackToMove;
+
+    if (t.hasPawns) {
+        int lead = t.get(type, 0, 0)->pieces[0] ^ flipColor;
+        chess::Bitboard b = leadPawnsBb = board.pieces(chess::PieceType::PAWN, lead & 8 ? chess::Color::BLACK : chess::Color::WHITE);
+        while (b) squares[size++] = b.pop() ^ flipSquares;
+        leadPawns = size;
+        std::swap(squares[0], *std::max_element(squares, squares + leadPawns, pawnsBefore));
+        file = squares[0] & 7;
+        if (file > 3) file = 7 - file;
+    }
+
+    if (type == DTZ && (t.get(DTZ, 0, file)->flags & STM) != stm && !(t.key == t.key2 && !t.hasPawns)) {
+        state = CHANGE_STM;
+        return 0;
+    }
+
+    chess::Bitboard b = board.occ() ^ leadPawnsBb;
+    while (b) {
+        int sq = b.pop();
+        squares[size] = sq ^ flipSquares;
+        pieces[size++] = pieceCode(board.at(chess::Square(sq))) ^ flipColor;
+    }
+
+    const Pairs *d = t.get(type, stm, file);
+    uint64_t idx = encode(t, d, squares, pieces, size, leadPawns);
+    return mapScore(t, type, file, decompress(d, idx), wdl);
+}
+
+namespace tbdetail {
+
+inline int probeWdlTable(const chess::Board &board, State &state)
+{
+    if (board.occ().count() == 2) return TB_DRAW;
+    auto it = tbTables.find(materialKey(board));
+    if (it == tbTables.end()) {
+        state = FAIL;
+        return TB_DRAW;
+    }
+    return probeTable(board, *it->second, WDL, TB_DRAW, state);
+}
+
+inline int dtzBeforeZeroing(int wdl)
+{
+    return wdl == TB_WIN ? 1 : wdl == TB_CURSED_WIN ? 101 : wdl == TB_BLESSED_LOSS ? -101 : wdl == TB_LOSS ? -1 : 0;
+}
+
+// The stored value need not be right where the side to move has a good
+// capture (the generator picks whatever compresses best there), so captures
+// are searched, and with ZEROING pawn moves too, for DTZ. The state says
+// whether the best move is a zeroing one.
+template <bool ZEROING, typename BoardT>
+int search(BoardT &board, State &state)
+{
+    int value, bestValue = TB_LOSS;
+    chess::Movelist moves;
+    chess::movegen::legalmoves<>(moves, board);
+    int moveCount = 0;
+
+    for (const auto &m : moves) {
+        if (!board.isCapture(m) && (!ZEROING || board.at(m.from()).type() != chess::PieceType::PAWN)) continue;
+        moveCount++;
+        board.makeMove(m);
+        value = -search<false>(board, state);
+        board.unmakeMove(m);
+        if (state == FAIL) return TB_DRAW;
+        if (value > bestValue) {
+            bestValue = value;
+            if (value >= TB_WIN) {
+                state = ZEROING_BEST_MOVE;
+                return value;
+            }
+        }
+    }
+
+    // When every legal move was searched the table is not needed, and it
+    // would be wrong e.g. for a position whose only moves are captures.
+    bool noMoreMoves = moveCount && moveCount == int(moves.size());
+    if (noMoreMoves) {
+        value = bestValue;
+    } else {
+        value = probeWdlTable(board, state);
+        if (state == FAIL) return TB_DRAW;
+    }
+
+    if (bestValue >= value) {
+        state = bestValue > TB_DRAW || noMoreMoves ? ZEROING_BEST_MOVE : OK;
+        return bestValue;
+    }
+    state = OK;
+    return value;
+}
+
+template <typename BoardT>
+int probeDtz(BoardT &board, State &state)
+{
+    state = OK;
+    int wdl = search<true>(board, state);
+    if (state == FAIL || wdl == TB_DRAW) return 0;
+    if (state == ZEROING_BEST_MOVE) return dtzBeforeZeroing(wdl);
+
+    auto it = tbTables.find(materialKey(board));
+    if (it == tbTables.end()) {
+        state = FAIL;
+        return 0;
+    }
+    int dtz = probeTable(board, *it->second, DTZ, wdl, state);
+    if (state == FAIL) return 0;
+    if (state != CHANGE_STM) return (dtz + 100 * (wdl == TB_BLESSED_LOSS || wdl == TB_CURSED_WIN)) * (wdl > 0 ? 1 : -1);
+
+    // The table holds the other side to move: take the best move's DTZ.
+    int minDtz = INT_MAX;
+    chess::Movelist moves;
+    chess::movegen::legalmoves<>(moves, board);
+    for (const auto &m : moves) {
+        bool zeroing = board.isCapture(m) || board.at(m.from()).type() == chess::PieceType::PAWN;
+        board.makeMove(m);
+        // For a zeroing move the DTZ is that of the move itself, with the
+        // sign of the result after it.
+        dtz = zeroing ? -dtzBeforeZeroing(search<false>(board, state)) : -probeDtz(board, state);
+        if (dtz == 1 && board.inCheck()) {
+            chess::Movelist replies;
+            chess::movegen::legalmoves<>(replies, board);
+            if (replies.empty()) minDtz = 1;
+        }
+        if (!zeroing) dtz += dtz > 0 ? 1 : dtz < 0 ? -1 : 0;
+        if (dtz < minDtz && (dtz > 0) == (wdl > 0) && dtz != 0) minDtz = dtz;
+        board.unmakeMove(m);
+        if (state == FAIL) return 0;
+    }
+    return minDtz == INT_MAX ? -1 : minDtz;
+}
+
+// "KRPvKR" into a table, or false if it is not a material code.
+inline bool parseCode(const std::string &code, Table &t)
+{
+    static const std::string letters = "PNBRQK";
+    size_t v = code.find('v');
+    if (v == std::string::npos || v == 0 || code[0] != 'K' || v + 1 >= code.size() || code[v + 1] != 'K') return false;
+
+    int counts[2][6] = {};
+    for (size_t i = 0; i < code.size(); i++) {
+        if (i == v) continue;
+        size_t pt = letters.find(code[i]);
+        if (pt == std::string::npos) return false;
+        counts[i > v][pt]++;
+    }
+    if (counts[0][5] != 1 || counts[1][5] != 1) return false;
+
+    t.code = code;
+    t.pieceCount = int(code.size()) - 1;
+    if (t.pieceCount > TB_MAX_PIECES) return false;
+    std::string sig = code.substr(0, v) + code.substr(v + 1);
+    t.key = materialKey(sig, chess::Color::WHITE);
+    t.key2 = materialKey(sig, chess::Color::BLACK);
+    t.hasPawns = counts[0][0] + counts[1][0] > 0;
+    for (const auto &side : counts) {
+        for (int pt = 0; pt < 5; pt++) t.hasUniquePieces |= side[pt] == 1;
+    }
+    // The leading colour is the one with fewer pawns, the strong side if equal.
+    bool strongLeads = !counts[1][0] || (counts[0][0] && counts[1][0] >= counts[0][0]);
+    t.pawnCount[0] = counts[strongLeads ? 0 : 1][0];
+    t.pawnCount[1] = counts[strongLeads ? 1 : 0][0];
+    return true;
+}
+
+}  // namespace tbdetail
+
+inline void tbFree()
+{
+    tbTables.clear();
+    tbTableList.clear();
+    tbLargest = 0;
+}
+
+// Registers the .rtbw files (and their .rtbz files, where present) in the
+// directories of `paths`, separated by ':'. Tables are mapped when first
+// probed. Returns the number of WDL tables found.
+inline int tbInit(const std::string &paths)
+{
+    tbFree();
+    std::vector<std::string> dirs;
+    for (size_t start = 0; start <= paths.size();) {
+        size_t end = paths.find(':', start);
+        if (end == std::string::npos) end = paths.size();
+        if (end > start) dirs.push_back(paths.substr(start, end - start));
+        start = end + 1;
+    }
+
+    std::unordered_map<std::string, std::string> dtzPaths;
+    std::vector<std::pair<std::string, std::string>> wdlPaths;
+    for (const auto &dir : dirs) {
+        std::error_code ec;
+        for (const auto &file : std::filesystem::directory_iterator(dir, ec)) {
+            const auto &p = file.path();
+            if (p.extension() == ".rtbw") wdlPaths.emplace_back(p.stem().string(), p.string());
+            if (p.extension() == ".rtbz") dtzPaths.emplace(p.stem().string(), p.string());
+        }
+    }
+
+    for (const auto &wdl : wdlPaths) {
+        auto table = std::make_unique<tbdetail::Table>();
+        if (!tbdetail::parseCode(wdl.first, *table) || tbTables.count(table->key)) continue;
+        table->files[tbdetail::WDL].path = wdl.second;
+        auto dtz = dtzPaths.find(wdl.first);
+        if (dtz != dtzPaths.end()) table->files[tbdetail::DTZ].path = dtz->second;
+        tbTables[table->key] = table.get();
+        tbTables[table->key2] = table.get();
+        tbLargest = std::max(tbLargest, table->pieceCount);
+        tbTableList.push_back(std::move(table));
+    }
+    return int(tbTableList.size());
+}
+
+// Whether the position is small enough and has no castling rights.
+inline bool tbCanProbe(const chess::Board &board)
+{
+    return tbLargest > 0 && board.occ().count() <= tbLargest
+           && !board.castlingRights().has(chess::Color::WHITE) && !board.castlingRights().has(chess::Color::BLACK);
+}
+
+// WDL for the side to move. Returns false if a table is missing.
+template <typename BoardT>
+bool tbProbeWdl(BoardT &board, TbWdl &wdl)
+{
+    if (!tbCanProbe(board)) return false;
+    auto state = tbdetail::OK;
+    int value = tbdetail::search<false>(board, state);
+    if (state == tbdetail::FAIL) return false;
+    wdl = TbWdl(value);
+    tbHits++;
+    return true;
+}
+
+// DTZ for the side to move, in plies: positive when winning, negative when
+// losing, 0 for a draw; cursed wins and blessed losses are 100 further out.
+// Can be off by one where the stored value is in moves. Returns false if a
+// table is missing.
+template <typename BoardT>
+bool tbProbeDtz(BoardT &board, int &dtz)
+{
+    if (!tbCanProbe(board)) return false;
+    auto state = tbdetail::OK;
+    dtz = tbdetail::probeDtz(board, state);
+    if (state == tbdetail::FAIL) return false;
+    tbHits++;
+    return true;
+}
+
+// Keeps only the root moves with the best tablebase result, ranked by DTZ
+// and the 50-move counter: wins that zero the counter in time, quickest
+// first, then the other wins, draws, losses the 50-move rule saves, and
+// losses, slowest first. Returns false, leaving the moves alone, if the root
+// is not in the tables.
+template <typename BoardT>
+bool tbFilterRootMoves(BoardT &board, chess::Movelist &moves)
+{
+    if (!tbCanProbe(board)) return false;
+    const int cnt50 = int(board.halfMoveClock());
+
+    int bestRank = INT_MIN;
+    std::vector<int> ranks;
+    for (const auto &m : moves) {
+        board.makeMove(m);
+        auto state = tbdetail::OK;
+        int dtz;
+        if (board.halfMoveClock() == 0) {
+            dtz = tbdetail::dtzBeforeZeroing(-tbdetail::search<false>(board, state));
+        } else {
+            dtz = -tbdetail::probeDtz(board, state);
+            dtz += dtz > 0 ? 1 : dtz < 0 ? -1 : 0;
+        }
+        if (dtz == 2 && board.inCheck()) {
+            chess::Movelist replies;
+            chess::movegen::legalmoves<>(replies, board);
+            if (replies.empty()) dtz = 1;
+        }
+        board.unmakeMove(m);
+        if (state == tbdetail::FAIL) return false;
+
+        int rank = dtz > 0 ? (dtz + cnt50 <= 100 ? 3000 - dtz : 1000 - dtz)
+                 : dtz < 0 ? (-dtz + cnt50 <= 100 ? -3000 - dtz : -1000 - dtz)
+                 : 0;
+        ranks.push_back(rank);
+        bestRank = std::max(bestRank, rank);
+    }
+    tbHits++;
+
+    chess::Movelist kept;
+    for (size_t i = 0; i < ranks.size(); i++) {
+        if (ranks[i] == bestRank) kept.add(moves[i]);
+    }
+    moves = kept;
+    return true;
+}
+
+#endif
@@ -0,0 +1,315 @@
+#include<iostream>
+#include "chess.hpp"
+#include "evaluate.hpp"
+#include "endgame.hpp"
+#include<vector>
+#include<string>
+#include<sstream>
+#include<fstream>
+#include<thread>
+#include<cmath>
+#include<chrono>
+using namespace std;
+using namespace chess;
+
+// Texel tuner for evalparams.hpp.
+//
+//   ./tuner <positions.epd|games.pgn> <output.hpp> [threads] [epochs]
+//
+// EPD/FEN lines carry the game result as "1-0", "0-1", "1/2-1/2" or as
+// [1.0] / [0.5] / [0.0]. PGN games use their Result header, and every quiet
+// position after the opening is taken; games without a decided Result are
+// skipped. The output path is required so that a run never overwrites the
+// tracked evalparams.hpp by accident; copy the output over it to adopt it.
+//
+// Each position is evaluated once while loading, with an EvalTrace recording the
+// count behind every weight. evaluateStatic is linear in the weights (its
+// middlegame/endgame switch counts material with fixed values, not the tuned
+// ones), so the tuner afterwards only needs a dot product per position per
+// epoch. Endings with their own evaluator or scale factor are left out, as
+// judged with the weights the tuner starts from.
+
+struct TuneCoeff {
+    uint8_t param;
+    int16_t count;
+};
+
+struct TuneEntry {
+    uint32_t coeffBegin;
+    uint16_t coeffCount;
+    float result;
+};
+
+vector<TuneEntry> entries;
+vector<TuneCoeff> coeffs;
+
+const int OPENING_SKIP_PLIES = 8;
+
+bool addPosition(const Board &board, double result)
+{
+    if (board.inCheck()) return false;
+    // Endings with their own evaluator or scaling are not linear in the weights.
+    int egScore;
+    if (board.isInsufficientMaterial() || probeEndgame(board, egScore)) return false;
+    if (endgameScale(board, 1) != SCALE_NORMAL || endgameScale(board, -1) != SCALE_NORMAL) return false;
+    Movelist ml;
+    movegen::legalmoves<>(ml, board);
+    if (ml.empty()) return false;
+
+    EvalTrace trace;
+    evaluateStatic(board, &trace);
+
+    TuneEntry entry;
+    entry.coeffBegin = coeffs.size();
+    entry.coeffCount = 0;
+    entry.result = result;
+    for (int i = 0; i < NUM_EVAL_PARAMS; i++) {
+        if (trace.coeffs[i] != 0) {
+            coeffs.push_back({(uint8_t)i, (int16_t)trace.coeffs[i]});
+            entry.coeffCount++;
+        }
+    }
+    entries.push_back(entry);
+    return true;
+}
+
+bool parseResult(const string &text, double &result)
+{
+    if (text.find("1/2-1/2") != string::npos || text.find("[0.5]") != string::npos) result = 0.5;
+    else if (text.find("1-0") != string::npos || text.find("[1.0]") != string::npos || text.find("[1]") != string::npos) result = 1.0;
+    else if (text.find("0-1") != string::npos || text.find("[0.0]") != string::npos || text.find("[0]") != string::npos) result = 0.0;
+    else return false;
+    return true;
+}
+
+void loadEpd(istream &in)
+{
+    string line;
+    while (getline(in, line)) {
+        double result;
+        if (!parseResult(line, result)) continue;
+
+        stringstream ss(line);
+        string field, fen;
+        for (int i = 0; i < 6 && ss >> field; i++) {
+            if (i >= 4 && !isdigit((unsigned char)field[0])) break;
+            fen += (i ? " " : "") + field;
+        }
+
+        Board board;
+        if (!board.setFen(fen)) continue;
+        addPosition(board, result);
+    }
+}
+
+class TunerVisitor : public pgn::Visitor {
+   public:
+    void startPgn() override {
+        board.setFen(constants::STARTPOS);
+        hasResult = false;
+        result = 0.5;
+        ply = 0;
+    }
+
+    void header(string_view key, string_view value) override {
+        if (key == "FEN") board.setFen(value);
+        if (key == "Result") hasResult = parseResult(string(value), result);
+    }
+
+    void startMoves() override {
+        if (!hasResult) skipPgn(true);
+    }
+
+    void move(string_view san, string_view) override {
+        Move m;
+        try {
+            m = uci::parseSan(board, san);
+        } catch (...) {
+            skipPgn(true);
+            return;
+        }
+        if (m == Move::NULL_MOVE) {
+            skipPgn(true);
+            return;
+        }
+
+        bool capture = board.isCapture(m);
+        board.makeMove(m);
+        ply++;
+
+        if (ply >= OPENING_SKIP_PLIES && !capture && m.typeOf() != Move::PROMOTION) {
+            addPosition(board, result);
+        }
+    }
+
+    void endPgn() override {}
+
+   private:
+    Board board;
+    double result = 0.5;
+    bool hasResult = false;
+    int ply = 0;
+};
+
+double sigmoid(double K, double eval)
+{
+    return 1.0 / (1.0 + pow(10.0, -K * eval / 400.0));
+}
+
+double entryEval(const TuneEntry &entry, const vector<double> &weights)
+{
+    double eval = 0;
+    for (uint32_t i = entry.coeffBegin; i < entry.coeffBegin + entry.coeffCount; i++) {
+        eval += coeffs[i].count * weights[coeffs[i].param];
+    }
+    return eval;
+}
+
+// Runs fn(begin, end, threadIndex) over the entries split into one chunk per thread.
+template <typename Fn>
+void parallelFor(int threads, Fn fn)
+{
+    vector<thread> pool;
+    size_t chunk = (entries.size() + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        size_t begin = t * chunk;
+        size_t end = min(entries.size(), begin + chunk);
+        if (begin >= end) break;
+        pool.emplace_back(fn, begin, end, t);
+    }
+    for (auto &th : pool) th.join();
+}
+
+double totalError(const vector<double> &weights, double K, int threads)
+{
+    vector<double> partial(threads, 0.0);
+    parallelFor(threads, [&](size_t begin, size_t end, int t) {
+        double sum = 0;
+        for (size_t i = begin; i < end; i++) {
+            double diff = entries[i].result - sigmoid(K, entryEval(entries[i], weights));
+            sum += diff * diff;
+        }
+        partial[t] = sum;
+    });
+    double sum = 0;
+    for (double p : partial) sum += p;
+    return sum / entries.size();
+}
+
+// Golden-section search for the scaling constant that best maps the untuned
+// eval onto game results.
+double findBestK(const vector<double> &weights, int threads)
+{
+    double lo = 0.05, hi = 5.0;
+    const double ratio = (sqrt(5.0) - 1) / 2;
+    for (int i = 0; i < 40; i++) {
+        double k1 = hi - ratio * (hi - lo);
+        double k2 = lo + ratio * (hi - lo);
+        if (totalError(weights, k1, threads) < totalError(weights, k2, threads)) hi = k2;
+        else lo = k1;
+    }
+    return (lo + hi) / 2;
+}
+
+void computeGradient(const vector<double> &weights, double K, int threads, vector<double> &gradient)
+{
+    vector<vector<double>> partial(threads, vector<double>(NUM_EVAL_PARAMS, 0.0));
+    parallelFor(threads, [&](size_t begin, size_t end, int t) {
+        vector<double> &g = partial[t];
+        for (size_t i = begin; i < end; i++) {
+            const TuneEntry &entry = entries[i];
+            double s = sigmoid(K, entryEval(entry, weights));
+            double d = (entry.result - s) * s * (1 - s);
+            for (uint32_t c = entry.coeffBegin; c < entry.coeffBegin + entry.coeffCount; c++) {
+                g[coeffs[c].param] += d * coeffs[c].count;
+            }
+        }
+    });
+
+    double scale = -2.0 * K * log(10.0) / 400.0 / entries.size();
+    for (int p = 0; p < NUM_EVAL_PARAMS; p++) {
+        double sum = 0;
+        for (int t = 0; t < threads; t++) sum += partial[t][p];
+        gradient[p] = scale * sum;
+    }
+}
+
+void writeHeader(const string &path, const vector<double> &weights)
+{
+    ofstream out(path);
+    out << "// Evaluation weights for evaluate.hpp.\n";
+    out << "// Generated by tuner.cpp; rerun the tuner instead of editing the values by hand.\n";
+    out << "#ifndef EVALPARAMS_HPP\n#define EVALPARAMS_HPP\n\n";
+    out << "enum EvalParam {\n";
+    for (int p = 0; p < NUM_EVAL_PARAMS; p++) out << "    " << evalParamNames[p] << ",\n";
+    out << "    NUM_EVAL_PARAMS\n};\n\n";
+    out << "const char *const evalParamNames[NUM_EVAL_PARAMS] = {\n";
+    for (int p = 0; p < NUM_EVAL_PARAMS; p++) out << "    \"" << evalParamNames[p] << "\",\n";
+    out << "};\n\n";
+    out << "const int evalParams[NUM_EVAL_PARAMS] = {\n";
+    for (int p = 0; p < NUM_EVAL_PARAMS; p++) out << "    " << lround(weights[p]) << ",  // " << evalParamNames[p] << "\n";
+    out << "};\n\n#endif\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        cerr << "usage: " << argv[0] << " <positions.epd|games.pgn> <output.hpp> [threads] [epochs]" << endl;
+        return 1;
+    }
+    string dataPath = argv[1];
+    string outPath = argv[2];
+    int threads = argc > 3 ? stoi(argv[3]) : max(1u, thread::hardware_concurrency());
+    int epochs = argc > 4 ? stoi(argv[4]) : 2000;
+
+    auto start = chrono::steady_clock::now();
+    ifstream in(dataPath);
+    if (!in) {
+        cerr << "cannot open " << dataPath << endl;
+        return 1;
+    }
+    if (dataPath.size() >= 4 && dataPath.substr(dataPath.size() - 4) == ".pgn") {
+        TunerVisitor visitor;
+        pgn::StreamParser parser(in);
+        parser.readGames(visitor);
+    } else {
+        loadEpd(in);
+    }
+    if (entries.empty()) {
+        cerr << "no labelled positions in " << dataPath << endl;
+        return 1;
+    }
+    auto loaded = chrono::steady_clock::now();
+    cout << "loaded " << entries.size() << " positions (" << coeffs.size() << " trace terms) in "
+         << chrono::duration_cast<chrono::milliseconds>(loaded - start).count() << " ms" << endl;
+
+    vector<double> weights(evalParams, evalParams + NUM_EVAL_PARAMS);
+    double K = findBestK(weights, threads);
+    cout << "K = " << K << ", initial error " << totalError(weights, K, threads) << endl;
+
+    // Adam, with the learning rate in centipawns per step.
+    const double rate = 1.0, beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    vector<double> gradient(NUM_EVAL_PARAMS), m(NUM_EVAL_PARAMS, 0.0), v(NUM_EVAL_PARAMS, 0.0);
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        computeGradient(weights, K, threads, gradient);
+        for (int p = 0; p < NUM_EVAL_PARAMS; p++) {
+            m[p] = beta1 * m[p] + (1 - beta1) * gradient[p];
+            v[p] = beta2 * v[p] + (1 - beta2) * gradient[p] * gradient[p];
+            double mHat = m[p] / (1 - pow(beta1, epoch));
+            double vHat = v[p] / (1 - pow(beta2, epoch));
+            weights[p] -= rate * mHat / (sqrt(vHat) + epsilon);
+        }
+        if (epoch % 100 == 0 || epoch == epochs) {
+            cout << "epoch " << epoch << " error " << totalError(weights, K, threads) << endl;
+        }
+    }
+
+    writeHeader(outPath, weights);
+    auto done = chrono::steady_clock::now();
+    cout << "wrote " << outPath << " after "
+         << chrono::duration_cast<chrono::milliseconds>(done - start).count() << " ms" << endl;
+    for (int p = 0; p < NUM_EVAL_PARAMS; p++) {
+        cout << evalParamNames[p] << " " << evalParams[p] << " -> " << lround(weights[p]) << endl;
+    }
+    return 0;
+}